@@ -317,7 +317,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam,
 
           Drop(hWnd, wmId - IDR_MENU1);
           if (!CheckGameOver()) {
-            Drop(hWnd, app_data.find_move(/*depth=*/6));
+            Drop(hWnd, app_data.find_move(/*depth=*/8));
             CheckGameOver();
           }
           break;
@@ -1,7 +1,12 @@
+#include <bit>
+#include <chrono>
 #include <cstdint>
+#include <filesystem>
 #include <format>
+#include <fstream>
 #include <iostream>
 #include <optional>
+#include <random>
 #include <stdexcept>
 #include <string>
 #include <tuple>
@@ -10,6 +15,11 @@
 
 #include "../board.h"
 #include "../cache.h"
+#include "../opening_book.h"
+#include "../solved_store.h"
+#include "../solver.h"
+#include "../transposition_table.h"
+#include "../vector_kernel.h"
 #include "gtest/gtest.h"
 
 Board parse(const std::string image) {
@@ -70,6 +80,23 @@ TEST(Game, Combos) {
       });
 }
 
+TEST(Game, WinningMasks) {
+  // The masks computed at compile time are the combos, in the same order.
+  constexpr Board::MaskArray masks = Board::winning_masks();
+  std::size_t i = 0;
+  Board::combos([&i, &masks](Board::Coord a, Board::Coord b, Board::Coord c,
+                             Board::Coord d) {
+    Board::BoardMask mask = 0;
+    for (const Board::Coord &coord : {a, b, c, d}) {
+      mask |= OneMask(coord.first * Board::kNumCols + coord.second);
+    }
+    ASSERT_LT(i, masks.size());
+    EXPECT_EQ(masks[i], mask) << i;
+    ++i;
+  });
+  EXPECT_EQ(i, masks.size());
+}
+
 TEST(Game, Board) {
   Board b;
   for (std::size_t row = 0; row < Board::kNumRows; ++row) {
@@ -275,6 +302,98 @@ TEST_F(ParseTest, Parse8) {
       2, 9);
 };
 
+TEST(ParseHexImage, RoundTrip) {
+  const Board::Position p = Board::ParsePosition(R"(
+1..2...
+1..1...
+2..2...
+2..11..
+1..122.
+21.2122
+)");
+  EXPECT_EQ(Board::ParseHexImage(p.HexImage()), p);
+
+  Board b;
+  b.push(3);
+  b.push(4);
+  const Board::Position q = Board::ParseHexImage(b.HexImage());
+  EXPECT_EQ(q.red_set, OneMask(3));
+  EXPECT_EQ(q.yellow_set, OneMask(4));
+
+  EXPECT_THROW(Board::ParseHexImage("00000000008"), std::runtime_error);
+  EXPECT_THROW(Board::ParseHexImage("0000000000g-00000000000"),
+               std::runtime_error);
+}
+
+TEST(Position, Key) {
+  const Board::Position p = Board::ParsePosition(R"(
+.......
+.......
+.......
+...2...
+..21...
+..112..
+)");
+  // Red to move: red's pieces, plus the lowest empty square in each column.
+  EXPECT_EQ(p.Key(), OneMask(2) | OneMask(3) | OneMask(10) | OneMask(0) |
+                         OneMask(1) | OneMask(16) | OneMask(24) |
+                         OneMask(11) | OneMask(5) | OneMask(6));
+
+  // The same squares, but with the colors swapped.
+  Board::Position q;
+  q.red_set = p.yellow_set;
+  q.yellow_set = p.red_set;
+  EXPECT_NE(q.Key(), p.Key());
+
+  // A full board has all its markers above the top row.
+  Board::Position full;
+  full.red_set = 0x2aaaaaaaaaa;
+  full.yellow_set = 0x15555555555;
+  EXPECT_EQ(full.Key(), full.red_set | (UINT64_C(0x7f) << Board::kBoardSize));
+}
+
+TEST(Position, Mirror) {
+  const Board::Position p = Board::ParsePosition(R"(
+.......
+.......
+.......
+...2...
+..21...
+..112..
+)");
+  EXPECT_EQ(p.Mirror().image(), R"(.......
+.......
+.......
+...2...
+...12..
+..211..
+)");
+  EXPECT_EQ(p.Mirror().Mirror(), p);
+  EXPECT_FALSE(p.IsSymmetric());
+  EXPECT_NE(p.Key(), p.Mirror().Key());
+  EXPECT_EQ(p.CanonicalKey(), p.Mirror().CanonicalKey());
+  EXPECT_EQ(MirrorMask(p.Key()), p.Mirror().Key());
+
+  const Board::Position q = Board::ParsePosition(R"(
+.......
+.......
+.......
+...2...
+.2.1.2.
+.1212..
+)");
+  EXPECT_FALSE(q.IsSymmetric());
+  EXPECT_TRUE(Board::ParsePosition(R"(
+.......
+.......
+.......
+...2...
+.2.1.2.
+.12121.
+)")
+                  .IsSymmetric());
+}
+
 TEST(LegalMoves, SomeMoves) {
   const Board::Position p = Board::ParsePosition(R"(
 1..2...
@@ -467,6 +586,43 @@ TEST_F(HeurTest, Heur5) {
       1000);
 }
 
+TEST(Heur, Incremental) {
+  // Play random games, backing up now and then. After every move, the
+  // heuristic that push and pop keep up to date should match that of a
+  // board built from scratch.
+  std::mt19937_64 random(2024);
+  for (int game = 0; game < 200; ++game) {
+    Board board;
+    board.set_favorite(game % 2 + 1);
+    for (int turn = 0; turn < 60; ++turn) {
+      const std::vector<std::size_t> moves = board.legal_moves();
+      if (moves.empty() || (board.HowFull() > 0 && random() % 4 == 0)) {
+        board.pop();
+      } else {
+        board.push(moves[random() % moves.size()]);
+      }
+      Board copy;
+      copy.set_favorite(board.favorite());
+      for (std::size_t row = 0; row < Board::kNumRows; ++row) {
+        for (std::size_t col = 0; col < Board::kNumCols; ++col) {
+          copy.set_value(row, col, board.get_value(row, col));
+        }
+      }
+      ASSERT_EQ(board.heuristic(), copy.heuristic()) << board.image();
+
+      // And without four in a row, it is the score from scratch.
+      const Board::Position position = Board::ParseHexImage(board.HexImage());
+      if (position.IsGameOver() == Board::Outcome::kContested) {
+        const bool red = board.favorite() == 1;
+        ASSERT_EQ(board.heuristic(),
+                  ReferenceScore(red ? position.red_set : position.yellow_set,
+                                 red ? position.yellow_set : position.red_set))
+            << board.image();
+      }
+    }
+  }
+}
+
 TEST(Eval, Empty) {
   Board b;
   // The first move on an empty board should be the center column.
@@ -592,6 +748,57 @@ Board::BoardMask BuildMask(std::size_t row, std::size_t col) {
   return UINT64_C(1) << (7 * row + col);
 }
 
+TEST(ThreeInRow, MatchesReference) {
+  // Random boards, at every density, with the pieces anywhere.
+  std::mt19937_64 random(12345);
+  const Board::BoardMask board_mask = OneMask(Board::kBoardSize) - 1;
+  for (int i = 0; i < 20000; ++i) {
+    const int density = i % 8;
+    Board::BoardMask occupied = board_mask;
+    for (int j = 0; j < density; ++j) {
+      occupied &= random();
+    }
+    if (i % 16 == 0) {
+      occupied = board_mask;
+    }
+    const Board::BoardMask red_set = occupied & random();
+    const Board::BoardMask yellow_set = occupied & ~red_set;
+    EXPECT_EQ(FindTriples(red_set), ReferenceFindTriples(red_set));
+    EXPECT_EQ(FindTriples(yellow_set), ReferenceFindTriples(yellow_set));
+    EXPECT_EQ(VectorFindTriples(red_set), ReferenceFindTriples(red_set));
+    EXPECT_EQ(VectorFindTriples(yellow_set), ReferenceFindTriples(yellow_set));
+    EXPECT_EQ(VectorScore(red_set, yellow_set),
+              ReferenceScore(red_set, yellow_set));
+
+    // VectorFindTriples and the rest only run one of these, depending on
+    // the processor, so check both.
+    for (const bool avx2 : {false, true}) {
+      if (avx2 && !HaveAvx2()) {
+        continue;
+      }
+      const auto find_triples =
+          avx2 ? detail::Avx2FindTriples : detail::ScalarFindTriples;
+      const auto score = avx2 ? detail::Avx2Score : detail::ScalarScore;
+      EXPECT_EQ(find_triples(red_set), ReferenceFindTriples(red_set));
+      EXPECT_EQ(find_triples(yellow_set), ReferenceFindTriples(yellow_set));
+      EXPECT_EQ(score(red_set, yellow_set),
+                ReferenceScore(red_set, yellow_set));
+    }
+
+    // When both players have four in a row, the two may name different
+    // winners, but that never happens in a real game.
+    if (!HasFourInARow(red_set) || !HasFourInARow(yellow_set)) {
+      const Board::Outcome outcome = ReferenceFindOutcome(red_set, yellow_set);
+      EXPECT_EQ(FindOutcome(red_set, yellow_set), outcome);
+      EXPECT_EQ(VectorFindOutcome(red_set, yellow_set), outcome);
+      EXPECT_EQ(detail::ScalarFindOutcome(red_set, yellow_set), outcome);
+      if (HaveAvx2()) {
+        EXPECT_EQ(detail::Avx2FindOutcome(red_set, yellow_set), outcome);
+      }
+    }
+  }
+}
+
 TEST(ThreeInRow, Empty) {
   const Board::Position p = Board::ParsePosition(R"(
 .......
@@ -910,6 +1117,26 @@ TEST(BruteForce, Draw) {
   EXPECT_EQ(move, 0);
 }
 
+TEST(BruteForce, NoSafeMoves) {
+  // Red has a threat above each of the places Yellow can play.
+  Board::Position p = Board::ParsePosition(R"(
+.22.222
+.11.122
+121.121
+1121112
+2211221
+1212112
+)");
+  EXPECT_EQ(p.WhoseTurn(), 2);
+  const auto [result, move] = Board::BruteForce(p);
+  EXPECT_EQ(DebugImage(result), "Lose");
+  EXPECT_EQ(MaskImage(move), "Row 3 Col 3, Row 4 Col 0");
+
+  TranspositionTable table(1);
+  EXPECT_EQ(Board::ProveValue(p, table, Board::BruteForceOptions()),
+            Metric(BruteForceResult::kLose, 1));
+}
+
 TEST(BruteForce, RedWinsNow) {
   Board::Position p = Board::ParsePosition(R"(
 .......
@@ -1002,6 +1229,389 @@ TEST(BruteForce, OneMore4) {
   EXPECT_EQ(MaskImage(move), "Row 1 Col 2");
 }
 
+TEST(BruteForce, ProveResult) {
+  const std::vector<std::pair<std::string, BruteForceResult>> cases = {
+      {R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)",
+       BruteForceResult::kWin},
+      {R"(
+....211
+....122
+2...211
+1..2122
+2.11212
+1121122
+)",
+       BruteForceResult::kLose},
+      {R"(
+...1...
+...21..
+.2.22.1
+.1.12.2
+22.2111
+1112122
+)",
+       BruteForceResult::kLose},
+      {R"(
+.......
+.......
+.......
+2.....2
+1.121.1
+1221221
+)",
+       BruteForceResult::kWin},
+  };
+  for (const auto &[image, expected] : cases) {
+    TranspositionTable table(1);
+    EXPECT_EQ(Board::ProveResult(Board::ParsePosition(image), table,
+                                 Board::BruteForceOptions()),
+              expected);
+  }
+}
+
+TEST(BruteForce, ProveValue) {
+  // The value of a position is the best of the values of its children,
+  // seen from the other side, and one move further away.
+  const Board::Position p = Board::ParsePosition(R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)");
+  TranspositionTable table(1);
+  const Board::BruteForceOptions options;
+  const Metric value = Board::ProveValue(p, table, options);
+  EXPECT_EQ(value.result, BruteForceResult::kWin);
+
+  Metric best(BruteForceResult::kNil, 0);
+  const Board::BoardMask legal_moves = p.LegalMoves();
+  for (std::size_t col = 0; col < Board::kNumCols; ++col) {
+    const Board::BoardMask move =
+        legal_moves & (Board::CreateColumnMask() << col);
+    if (move == 0) {
+      continue;
+    }
+    Board::Position child = p;
+    child.red_set |= move;
+    Metric child_value;
+    if (child.IsGameOver() == Board::Outcome::kRedWins) {
+      child_value = Metric(BruteForceResult::kLose, 0);
+    } else {
+      child_value = Board::ProveValue(child, table, options);
+    }
+    const Metric seen(child_value.result == BruteForceResult::kWin
+                          ? BruteForceResult::kLose
+                      : child_value.result == BruteForceResult::kLose
+                          ? BruteForceResult::kWin
+                          : BruteForceResult::kDraw,
+                      child_value.depth + 1);
+    if (compare(seen, best) > 0) {
+      best = seen;
+    }
+  }
+  EXPECT_EQ(value, best);
+}
+
+TEST(BruteForce, Symmetric) {
+  // Only the left half of the board is searched, but the moves on the
+  // right are reported too.
+  Board::Position p = Board::ParsePosition(R"(
+.......
+.......
+.......
+2.....2
+1.121.1
+1221221
+)");
+  EXPECT_TRUE(p.IsSymmetric());
+  const auto [result, move] = Board::BruteForce(p);
+  EXPECT_EQ(DebugImage(result), "Win");
+  EXPECT_EQ(MaskImage(move), "Row 2 Col 2, Row 2 Col 4");
+}
+
+TEST(Solve, Proven) {
+  // Given the time, Solve finds what BruteForce does.
+  const std::vector<std::string> images = {
+      R"(
+2......
+1.....1
+2.....1
+1...212
+2212121
+1112212
+)",
+      R"(
+....211
+....122
+2...211
+1..2122
+2.11212
+1121122
+)",
+      R"(
+...1...
+...21..
+.2.22.1
+.1.12.2
+22.2111
+1112122
+)",
+      // Shallow searches find a forced win here before they can see all
+      // the moves that win as quickly.
+      R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)",
+  };
+  for (const std::string &image : images) {
+    const Board::Position p = Board::ParsePosition(image);
+    const auto [result, move] = Board::BruteForce(p);
+    const Board::SolveResult solved = Board::Solve(
+        p, std::chrono::steady_clock::now() + std::chrono::hours(1));
+    EXPECT_TRUE(solved.proven);
+    EXPECT_EQ(solved.result, result);
+    EXPECT_EQ(MaskImage(solved.move), MaskImage(move));
+  }
+}
+
+TEST(Solve, Deadline) {
+  // Far too hard to solve in no time at all, but there is still a move.
+  const Board::Position p = Board::ParsePosition(R"(
+.......
+...1...
+..122..
+..211.2
+..122.1
+..211.2
+)");
+  TranspositionTable table;
+  const Board::SolveResult solved = Board::Solve(
+      p, table, std::chrono::steady_clock::now(), Board::BruteForceOptions());
+  EXPECT_FALSE(solved.proven);
+  EXPECT_EQ(solved.result, BruteForceResult::kDraw);
+  EXPECT_GE(solved.depth, 1);
+  EXPECT_NE(solved.move, 0);
+  EXPECT_EQ(solved.move & ~p.LegalMoves(), 0);
+
+  // What the table learned is still true.
+  const auto [result, move] = Board::BruteForce(p, table);
+  EXPECT_EQ(DebugImage(result), "Win");
+  EXPECT_EQ(MaskImage(move), "Row 4 Col 4");
+}
+
+TEST(BruteForce, Threads) {
+  // The threads race each other, but they all find the same answer.
+  Board::Position p = Board::ParsePosition(R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)");
+  for (auto parallelism :
+       {Board::Parallelism::kLazySmp, Board::Parallelism::kSplit}) {
+    for (unsigned int num_threads : {1, 2, 4}) {
+      TranspositionTable table(1);
+      Board::BruteForceOptions options;
+      options.num_threads = num_threads;
+      options.parallelism = parallelism;
+      const auto [result, move] = Board::BruteForce(p, table, options);
+      EXPECT_EQ(DebugImage(result), "Win");
+      EXPECT_EQ(MaskImage(move), "Row 4 Col 1, Row 4 Col 5, Row 5 Col 0");
+    }
+  }
+}
+
+TEST(BruteForce, Ordering) {
+  // The order of the moves changes how much is searched, but not the
+  // answer.
+  Board::Position p = Board::ParsePosition(R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)");
+  for (auto ordering :
+       {Board::MoveOrdering::kStatic, Board::MoveOrdering::kHistory,
+        Board::MoveOrdering::kThreats}) {
+    for (auto parallelism :
+         {Board::Parallelism::kLazySmp, Board::Parallelism::kSplit}) {
+      TranspositionTable table(1);
+      Board::SearchStats stats;
+      Board::BruteForceOptions options;
+      options.num_threads = 2;
+      options.parallelism = parallelism;
+      options.ordering = ordering;
+      options.stats = &stats;
+      const auto [result, move] = Board::BruteForce(p, table, options);
+      EXPECT_EQ(DebugImage(result), "Win");
+      EXPECT_EQ(MaskImage(move), "Row 4 Col 1, Row 4 Col 5, Row 5 Col 0");
+      if (Board::kSearchStats) {
+        EXPECT_GT(stats.nodes, 0);
+        EXPECT_GT(stats.cutoffs, 0);
+        EXPECT_LE(stats.cutoffs, stats.nodes);
+        EXPECT_LE(stats.cutoffs_by_move[0], stats.cutoffs);
+      }
+    }
+  }
+}
+
+TEST(BruteForce, Stats) {
+  if (!Board::kSearchStats) {
+    GTEST_SKIP() << "built with C4_SEARCH_STATS=0";
+  }
+  const Board::Position p = Board::ParsePosition(R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)");
+  TranspositionTable table(1);
+  Board::SearchStats stats;
+  Board::BruteForceOptions options;
+  options.stats = &stats;
+  Board::BruteForce(p, table, options);
+
+  EXPECT_GT(stats.nodes, 0);
+  EXPECT_LE(stats.forced_blocks, stats.nodes);
+  EXPECT_GT(stats.immediate_wins, 0);
+  EXPECT_GT(stats.forced_losses, 0);
+  EXPECT_GT(stats.max_depth, 0);
+  EXPECT_LE(stats.max_depth,
+            Board::kBoardSize - std::popcount(p.red_set | p.yellow_set));
+  EXPECT_GT(stats.seconds, 0);
+
+  // Each cutoff is counted once by depth and once by move.
+  std::uint64_t by_depth = 0;
+  for (const std::uint64_t count : stats.cutoffs_by_depth) {
+    by_depth += count;
+  }
+  std::uint64_t by_move = 0;
+  for (const std::uint64_t count : stats.cutoffs_by_move) {
+    by_move += count;
+  }
+  EXPECT_GT(stats.cutoffs, 0);
+  EXPECT_EQ(by_depth, stats.cutoffs);
+  EXPECT_EQ(by_move, stats.cutoffs);
+
+  EXPECT_LE(stats.table_hits, stats.table_probes);
+  EXPECT_GT(stats.table_stores, 0);
+  EXPECT_LE(stats.table_evictions, stats.table_stores);
+}
+
+TEST(Solver, Batch) {
+  // The positions of a game, starting from this one.
+  Board board = parse(R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)");
+  board.set_whose_turn();
+  std::vector<Board::Position> game;
+  for (const std::size_t col : {1, 1, 4, 2, 2, 6}) {
+    game.push_back(Board::ParseHexImage(board.HexImage()));
+    board.push(col);
+  }
+  game.push_back(Board::ParseHexImage(board.HexImage()));
+
+  // Mix them up with a position from another game, and with the mirror
+  // image of one of them.
+  const std::vector<Board::Position> batch = {
+      game[2],          game[5], Board::ParsePosition(R"(
+2......
+1.....1
+2.....1
+1...212
+2212121
+1112212
+)"),
+      game[6].Mirror(), game[0], game[3], game[1], game[4]};
+  for (const Board::Position &position : batch) {
+    ASSERT_EQ(position.IsGameOver(), Board::Outcome::kContested)
+        << position.image();
+  }
+
+  // The game runs from the end back to the start, with the mirror image
+  // in its place.
+  const std::vector<std::size_t> order = Solver::BatchOrder(batch);
+  EXPECT_EQ(order, std::vector<std::size_t>({3, 1, 7, 5, 0, 6, 4, 2}));
+
+  Solver solver(1);
+  const std::vector<Board::BruteForceReturn4> solutions =
+      solver.SolveBatch(batch);
+  ASSERT_EQ(solutions.size(), batch.size());
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    TranspositionTable table(1);
+    const auto [result, move] = Board::BruteForce(batch[i], table);
+    EXPECT_EQ(solutions[i].result, result) << i;
+    EXPECT_EQ(solutions[i].move, move) << i;
+  }
+
+  // Solving them several at a time makes no difference, whether or not
+  // the threads share a table.
+  for (const Solver::TablePolicy policy :
+       {Solver::TablePolicy::kShared, Solver::TablePolicy::kPrivate}) {
+    Solver parallel(1);
+    Solver::BatchStats stats;
+    const std::vector<Board::BruteForceReturn4> parallel_solutions =
+        parallel.ParallelSolveBatch(
+            batch,
+            Solver::BatchOptions{.num_threads = 3, .table_policy = policy},
+            &stats);
+    ASSERT_EQ(parallel_solutions.size(), batch.size());
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      EXPECT_EQ(parallel_solutions[i].result, solutions[i].result) << i;
+      EXPECT_EQ(parallel_solutions[i].move, solutions[i].move) << i;
+    }
+    EXPECT_EQ(stats.latencies.size(), batch.size());
+    if (Board::kSearchStats) {
+      EXPECT_GT(stats.search.nodes, 0);
+    }
+    EXPECT_LE(stats.search.table_hits, stats.search.table_probes);
+    EXPECT_LE(stats.Percentile(0.5), stats.Percentile(1));
+  }
+}
+
+TEST(BruteForce, SplitCurrentLimit) {
+  // Deep enough that the helpers get to split nodes of their own.
+  Board::Position p = Board::ParsePosition(R"(
+.......
+...1...
+..122..
+..211.2
+..122.1
+..211.2
+)");
+  TranspositionTable table(16);
+  Board::BruteForceOptions options;
+  options.num_threads = 3;
+  options.parallelism = Board::Parallelism::kSplit;
+  const auto [result, move] = Board::BruteForce(p, table, options);
+  EXPECT_EQ(DebugImage(result), "Win");
+  EXPECT_EQ(MaskImage(move), "Row 4 Col 4");
+}
+
 struct CacheData {
   std::uint64_t key1;
   std::uint64_t key2;
@@ -1143,6 +1753,16 @@ TEST(Cache, ShuffleAndDrop) {
   }
 }
 
+TEST(Cache, RecycledValue) {
+  // A node taken from the end of the LRU list must not carry over the
+  // value of the key it used to hold.
+  Cache<CacheKey, std::optional<std::size_t>> cache(11, 2);
+  *cache.GetOrAdd(CacheKey(0, 100)) = 1000;
+  *cache.GetOrAdd(CacheKey(1, 100)) = 1001;
+  EXPECT_FALSE(cache.GetOrAdd(CacheKey(2, 100))->has_value());
+  EXPECT_FALSE(cache.Lookup(CacheKey(0, 100)).has_value());
+}
+
 TEST(Cache, TableSizes) {
   Cache<CacheKey, std::size_t> a(1, 10);
   EXPECT_EQ(a.hash_shift(), 64);
@@ -1165,3 +1785,296 @@ TEST(Cache, TableSizes) {
   Cache<CacheKey, std::size_t> g(65, 10);
   EXPECT_EQ(g.hash_shift(), 57);
 }
+
+TEST(Score, MatchesMetric) {
+  // From best to worst.
+  std::vector<Metric> metrics = {Metric(BruteForceResult::kInf, 0)};
+  for (std::size_t depth = 0; depth <= kMaxScoreDepth; ++depth) {
+    metrics.emplace_back(BruteForceResult::kWin, depth);
+  }
+  metrics.emplace_back(BruteForceResult::kDraw, 0);
+  for (std::size_t depth = kMaxScoreDepth + 1; depth-- > 0;) {
+    metrics.emplace_back(BruteForceResult::kLose, depth);
+  }
+  metrics.emplace_back();
+
+  for (std::size_t i = 0; i < metrics.size(); ++i) {
+    const Metric &metric = metrics[i];
+    EXPECT_EQ(ToMetric(ToScore(metric)), metric);
+    EXPECT_EQ(ToScore(metrics[metrics.size() - 1 - i]), -ToScore(metric));
+    for (std::size_t j = 0; j < metrics.size(); ++j) {
+      EXPECT_EQ(compare(metric, metrics[j]), (i < j) - (i > j));
+    }
+  }
+
+  // The depth of a draw does not matter.
+  EXPECT_EQ(ToScore(Metric(BruteForceResult::kDraw, 17)), 0);
+}
+
+TEST(TranspositionTable, StoreAndLookup) {
+  using Bounds = TranspositionTable::Bounds;
+  TranspositionTable table(1);
+  EXPECT_EQ(table.capacity(), 131072);
+
+  const Board::Position p = Board::ParsePosition(R"(
+.......
+.......
+.......
+.......
+..222..
+..111..
+)");
+  EXPECT_FALSE(table.Lookup(p, 0).has_value());
+
+  // Depths are stored relative to the position, so the same entry is
+  // seen at different depths from different roots.
+  const Score win = WinScore(7);
+  table.Store(p, 5, Bounds(win, win));
+  const auto found = table.Lookup(p, 2);
+  ASSERT_TRUE(found.has_value());
+  EXPECT_TRUE(found->exact());
+  EXPECT_EQ(found->lower, WinScore(4));
+
+  const Score lose = LossScore(7);
+  table.Store(p, 5, Bounds(kNilScore, lose));
+  EXPECT_EQ(table.Lookup(p, 2)->upper, LossScore(4));
+  EXPECT_THROW(table.Store(p, 8, Bounds(win, win)), std::runtime_error);
+
+  Board::Position q = p;
+  q.red_set |= OneMask(1);
+  EXPECT_FALSE(table.Lookup(q, 5).has_value());
+}
+
+TEST(TranspositionTable, BestColumn) {
+  using Bounds = TranspositionTable::Bounds;
+  TranspositionTable table(1);
+  const Board::Position p = Board::ParsePosition(R"(
+.......
+.......
+.......
+.......
+.22....
+.111...
+)");
+  const Bounds draw(0, 0);
+  table.Store(p, 0, draw, 4);
+  auto found = table.Probe(p, 0);
+  ASSERT_TRUE(found.has_value());
+  EXPECT_EQ(found->column, 4);
+
+  // The mirror image shares the entry, and sees the mirrored column.
+  found = table.Probe(p.Mirror(), 0);
+  ASSERT_TRUE(found.has_value());
+  EXPECT_EQ(found->column, 2);
+
+  // Storing bounds without a column keeps the old one.
+  table.Store(p.Mirror(), 0, draw);
+  found = table.Probe(p, 0);
+  ASSERT_TRUE(found.has_value());
+  EXPECT_EQ(found->column, 4);
+}
+
+TEST(TranspositionTable, CombineBounds) {
+  using Bounds = TranspositionTable::Bounds;
+  const Score lose = LossScore(9);
+  const Score draw = 0;
+  const Score win = WinScore(9);
+
+  // A value outside the window is only a bound.
+  const Bounds high = Bounds::FromSearch(win, draw, lose);
+  EXPECT_EQ(high, Bounds(win, kInfScore));
+  const Bounds low = Bounds::FromSearch(lose, win, draw);
+  EXPECT_EQ(low, Bounds(kNilScore, lose));
+  EXPECT_TRUE(Bounds::FromSearch(draw, win, lose).exact());
+
+  EXPECT_EQ(high.Decide(draw, lose), win);
+  EXPECT_FALSE(high.Decide(WinScore(5), lose));
+  EXPECT_EQ(low.Decide(win, draw), lose);
+  EXPECT_FALSE(low.Decide(win, LossScore(5)));
+
+  TranspositionTable table(1);
+  const Board::Position p;
+  table.Store(p, 0, Bounds::FromSearch(draw, draw, lose));
+  table.Store(p, 0, Bounds::FromSearch(draw, win, draw));
+  const auto found = table.Lookup(p, 0);
+  ASSERT_TRUE(found.has_value());
+  EXPECT_TRUE(found->exact());
+  EXPECT_EQ(found->lower, 0);
+}
+
+TEST(TranspositionTable, Replacement) {
+  using Bounds = TranspositionTable::Bounds;
+  const Bounds exact(0, 0);
+
+  // A zero-megabyte table has a single bucket of eight entries.
+  TranspositionTable table(0);
+  EXPECT_EQ(table.capacity(), 8);
+
+  // Positions with more pieces are cheaper to recompute.
+  std::vector<Board::Position> positions(1);
+  positions[0].red_set = OneMask(3);
+  for (const Board::BoardMask red : {OneMask(3), OneMask(4)}) {
+    for (const Board::BoardMask yellow :
+         {OneMask(0), OneMask(1), OneMask(2), red << Board::kNumCols}) {
+      Board::Position p;
+      p.red_set = red;
+      p.yellow_set = yellow;
+      positions.push_back(p);
+    }
+  }
+  for (std::size_t i = 0; i < 8; ++i) {
+    table.Store(positions[i], 0, exact);
+  }
+  table.Store(positions[8], 0, exact);
+  const auto count_found = [&table, &positions]() {
+    return std::count_if(positions.begin() + 1, positions.end(),
+                         [&table](const Board::Position &p) {
+                           return table.Lookup(p, 0).has_value();
+                         });
+  };
+  EXPECT_TRUE(table.Lookup(positions[0], 0).has_value());
+  EXPECT_EQ(count_found(), 7);
+
+  // Entries from an earlier search go first, even though this position
+  // is cheaper than any of them.
+  table.NewSearch();
+  Board::Position crowded;
+  crowded.red_set = OneMask(3) | OneMask(17);
+  crowded.yellow_set = OneMask(4) | OneMask(10);
+  table.Store(crowded, 0, exact);
+  EXPECT_TRUE(table.Lookup(crowded, 0).has_value());
+  EXPECT_TRUE(table.Lookup(positions[0], 0).has_value());
+  EXPECT_EQ(count_found(), 6);
+
+  table.Clear();
+  EXPECT_FALSE(table.Lookup(crowded, 0).has_value());
+}
+
+TEST(OpeningBook, WriteAndLookup) {
+  Board::Position p = Board::ParsePosition(R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)");
+  const Board::BruteForceReturn4 solution = Board::BruteForce(p);
+  const Board::Position q = Board::ParsePosition(R"(
+.......
+.......
+.......
+.......
+.......
+...1...
+)");
+
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "Connect4test.book").string();
+  {
+    OpeningBook::Writer writer;
+    writer.Add(p.Mirror(), Board::BruteForceReturn4(
+                               solution.result, MirrorMask(solution.move)));
+    // Not a real solution, but it shows that the book is believed.
+    writer.Add(q, Board::BruteForceReturn4(BruteForceResult::kLose,
+                                           OneMask(3 + Board::kNumCols)));
+    writer.Write(path, 1);
+  }
+
+  {
+    const OpeningBook book(path);
+    EXPECT_EQ(book.size(), 2);
+    EXPECT_EQ(book.max_plies(), 1);
+
+    // The book holds the mirror image of p.
+    const auto found = book.Lookup(p);
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->result, solution.result);
+    EXPECT_EQ(found->move, solution.move);
+    EXPECT_FALSE(book.Lookup(Board::Position()).has_value());
+
+    TranspositionTable table(1);
+    Board::BruteForceOptions options;
+    options.book = &book;
+    const auto [result, move] = Board::BruteForce(q, table, options);
+    EXPECT_EQ(DebugImage(result), "Lose");
+    EXPECT_EQ(MaskImage(move), "Row 1 Col 3");
+
+    Board b;
+    b.push(3);
+    b.set_favorite(2);
+    b.set_book(&book);
+    EXPECT_EQ(b.find_move(/*depth=*/1), 3);
+  }
+  std::filesystem::remove(path);
+  EXPECT_THROW(OpeningBook book(path), std::runtime_error);
+}
+
+TEST(SolvedStore, AddFlushAndReopen) {
+  const Board::Position p = Board::ParsePosition(R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)");
+  const Board::Position q = Board::ParsePosition(R"(
+.......
+.......
+.......
+.......
+.......
+...1...
+)");
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "Connect4test.store").string();
+  std::filesystem::remove(path);
+
+  Board::BruteForceReturn4 solution;
+  {
+    // Solving the mirror image of p puts p in the store.
+    SolvedStore store(path);
+    EXPECT_EQ(store.num_runs(), 0);
+    TranspositionTable table(1);
+    Board::BruteForceOptions options;
+    options.store = &store;
+    solution = Board::BruteForce(p.Mirror(), table, options);
+    const auto found = store.Lookup(p);
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->value.result, solution.result);
+    EXPECT_EQ(found->move, MirrorMask(solution.move));
+    store.Flush();
+  }
+
+  // Another process might have been writing a run when it died.
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    file.write("C4STORE1\x05\0\0\0\0\0\0\0junk", 20);
+  }
+
+  {
+    // A second store adds another run, and ignores the torn one.
+    SolvedStore store(path);
+    EXPECT_EQ(store.num_runs(), 1);
+    // Not a real solution, but it shows that the store is believed.
+    store.Add(q, SolvedStore::Entry{Metric(BruteForceResult::kLose, 3),
+                                    OneMask(3 + Board::kNumCols)});
+  }
+
+  SolvedStore store(path);
+  EXPECT_EQ(store.num_runs(), 2);
+  const auto found = store.Lookup(p);
+  ASSERT_TRUE(found.has_value());
+  TranspositionTable table(1);
+  EXPECT_EQ(found->value, Board::ProveValue(p, table, {}));
+  EXPECT_EQ(found->move, MirrorMask(solution.move));
+  EXPECT_FALSE(store.Lookup(Board::Position()).has_value());
+
+  Board::BruteForceOptions options;
+  options.store = &store;
+  EXPECT_EQ(DebugImage(Board::ProveResult(q, table, options)), "Lose");
+  const auto [result, move] = Board::BruteForce(q, table, options);
+  EXPECT_EQ(MaskImage(move), "Row 1 Col 3");
+  std::filesystem::remove(path);
+}
@@ -1,5 +1,6 @@
 #include "board.h"
 
+#include <algorithm>
 #include <bit>
 #include <cassert>
 #include <compare>
@@ -14,7 +15,7 @@
 #include <utility>
 #include <vector>
 
-#include "cache.h"
+#include "opening_book.h"
 
 class nullbuf : public std::streambuf {
  protected:
@@ -94,31 +95,53 @@ Board::Coord FromIndex(std::size_t index) {
   return std::make_pair(row, col);
 }
 
-const Board::MaskArray all_winning_masks = Board::winning_masks();
+constexpr Board::MaskArray all_winning_masks = Board::winning_masks();
+constexpr Board::PartialWins all_partial_wins = Board::ComputePartialWins();
 
-Board::PartialWins Board::ComputePartialWins() {
-  PartialWins result;
-  for (std::vector<std::size_t> &v : result) {
-    v.reserve(16);
-  }
-  // Invert all_winning_masks.
-  // For every 1 bit in all_winning_masks[i], append the mask into the vector
-  // corresponding to the position of that bit.
-  for (const BoardMask mask : all_winning_masks) {
-    for (std::size_t j = 0; j < result.size(); ++j) {
-      if ((mask >> j) & 1) {
-        result[j].push_back(mask);
-      }
+// The center squares are in 13 four-in-a-rows, the most of any.
+static_assert(std::ranges::max(all_partial_wins.counts) == 13);
+
+// The contribution of a four-in-a-row to Board::score_, indexed by the
+// number of red and yellow pieces in it.
+constexpr auto kLineScore = [] {
+  std::array<std::array<int, 5>, 5> result{};
+  for (int red = 0; red <= 4; ++red) {
+    for (int yellow = 0; yellow <= 4; ++yellow) {
+      result[red][yellow] = yellow == 0 ? red : red == 0 ? -yellow : 0;
     }
   }
   return result;
+}();
+
+void Board::Count(int index, unsigned int player, int delta) {
+  // Split by player, so that each loop has no branches.
+  if (player == 1) {
+    for (const std::size_t i : all_partial_wins[index]) {
+      PieceCounts &counts = counts_[i];
+      const int before = counts.red_count;
+      const int after = before + delta;
+      score_ += kLineScore[after][counts.yellow_count] -
+                kLineScore[before][counts.yellow_count];
+      red_fours_ += (after == 4) - (before == 4);
+      counts.red_count = after;
+    }
+  } else {
+    for (const std::size_t i : all_partial_wins[index]) {
+      PieceCounts &counts = counts_[i];
+      const int before = counts.yellow_count;
+      const int after = before + delta;
+      score_ += kLineScore[counts.red_count][after] -
+                kLineScore[counts.red_count][before];
+      yellow_fours_ += (after == 4) - (before == 4);
+      counts.yellow_count = after;
+    }
+  }
 }
 
-const Board::PartialWins all_partial_wins = Board::ComputePartialWins();
-
 void Board::set_value(std::size_t row, std::size_t col, unsigned int value) {
   const std::size_t position = Index(row, col);
   const BoardMask mask = OneMask(position);
+  const unsigned int old_value = get_value(row, col);
 
   BoardMask unmask = ~mask;
   switch (value) {
@@ -141,6 +164,14 @@ void Board::set_value(std::size_t row, std::size_t col, unsigned int value) {
     default:
       throw std::runtime_error(std::format("Bad value {}", value));
   }
+
+  // Take out the old pieces and put in the new ones.
+  for (const unsigned int player : {1, 2}) {
+    const int delta = ((value & player) != 0) - ((old_value & player) != 0);
+    if (delta != 0) {
+      Count(position, player, delta);
+    }
+  }
 }
 
 unsigned int Board::get_value(std::size_t row, std::size_t col) const {
@@ -187,23 +218,6 @@ std::size_t Board::drop(std::size_t column) {
   throw std::runtime_error("Column is full");
 }
 
-// Given a board position, decide whose turn it is.
-// Returns 1 for red and 2 for yellow.
-unsigned int GetWhoseTurn(const Board::Position &p) {
-  if ((p.red_set & p.yellow_set) != 0) {
-    throw std::runtime_error("red/yellow overlap");
-  }
-  const int red_count = std::popcount(p.red_set);
-  const int yellow_count = std::popcount(p.yellow_set);
-  if (red_count == yellow_count) {
-    return 1;  // red
-  }
-  if (red_count == yellow_count + 1) {
-    return 2;  // yellow
-  }
-  throw std::runtime_error("red/yellow unbalanced");
-}
-
 // Given a board position, decide whose turn it is.
 // Returns 1 for red and 2 for yellow.
 unsigned int Board::Position::WhoseTurn() const {
@@ -241,41 +255,17 @@ void Board::clear() {
   yellow_set_ = 0;
   stack_size_ = 0;
   whose_turn_ = 1;
+  std::fill(std::begin(counts_), std::end(counts_), PieceCounts{});
+  score_ = 0;
+  red_fours_ = 0;
+  yellow_fours_ = 0;
 
   // The computer goes second unless the human presses the "Go Second"
   // button.
   favorite_ = 2;
 }
 
-// Compute a mask with a 1 set in every row of the lefmost column.
-Board::BoardMask Board::CreateColumnMask() {
-  BoardMask result = 0;
-  for (std::size_t index = 0; index < kBoardSize; index += kNumCols) {
-    result |= OneMask(index);
-  }
-  return result;
-}
-
-const Board::BoardMask column_mask = Board::CreateColumnMask();
-
-static std::array<Board::BoardMask, Board::kNumCols> CreateOrderedColumns() {
-  // Alpha-beta pruning is faster if we are lucky enough to evaluate
-  // a move with a good Metric first. This will result in a high accum,
-  // which turns into a low cutoff at the next level, which means
-  // evaluating fewer subtrees.
-  //
-  // We use the crude heuristic that moves in the center of the board
-  // tend to be better than moves at the edges.
-  constexpr std::array shuffle = {3, 2, 4, 1, 5, 0, 6};
-  std::array<Board::BoardMask, Board::kNumCols> result;
-  for (std::size_t i = 0; i < result.size(); ++i) {
-    result[i] = column_mask << shuffle[i];
-  }
-  return result;
-}
-
-const std::array<Board::BoardMask, Board::kNumCols> ordered_columns =
-    CreateOrderedColumns();
+constexpr Board::BoardMask column_mask = Board::CreateColumnMask();
 
 void Board::push(std::size_t column) {
   const int bit_pos =
@@ -297,6 +287,7 @@ void Board::push(std::size_t column) {
   } else {
     yellow_set_ |= mask;
   }
+  Count(bit_pos, whose_turn_, 1);
   whose_turn_ = 3 - whose_turn_;
 }
 
@@ -306,6 +297,9 @@ void Board::pop() {
   }
   whose_turn_ = 3 - whose_turn_;
   --stack_size_;
+  const BoardMask mask = (red_set_ ^ new_stack_[stack_size_].red_set) |
+                         (yellow_set_ ^ new_stack_[stack_size_].yellow_set);
+  Count(std::countr_zero(mask), whose_turn_, -1);
   red_set_ = new_stack_[stack_size_].red_set;
   yellow_set_ = new_stack_[stack_size_].yellow_set;
 }
@@ -340,61 +334,113 @@ void Board::combos(
   }
 }
 
-Board::MaskArray Board::winning_masks() {
-  Board::MaskArray result;
-  std::size_t i = 0;
-  combos([&i, &result](Coord a, Coord b, Coord c, Coord d) {
-    BoardMask mask = 0;
-    mask |= OneMask(Index(a));
-    mask |= OneMask(Index(b));
-    mask |= OneMask(Index(c));
-    mask |= OneMask(Index(d));
-
-    result[i++] = mask;
-  });
-  assert(i == result.max_size());
+Board::Outcome Board::IsGameOver() const {
+  return FindOutcome(red_set_, yellow_set_);
+}
 
-  return result;
+Board::Outcome Board::Position::IsGameOver() const {
+  return FindOutcome(red_set, yellow_set);
 }
 
-Board::Outcome Board::IsGameOver() const {
-  Outcome result = Outcome::kDraw;
-  for (BoardMask mask : all_winning_masks) {
-    if ((red_set_ & mask) == mask) {
-      result = Outcome::kRedWins;
-      break;
-    }
-    if ((yellow_set_ & mask) == mask) {
-      result = Outcome::kYellowWins;
-      break;
-    }
-    if ((red_set_ & mask) == 0 || (yellow_set_ & mask) == 0) {
-      result = Outcome::kContested;
-    }
+namespace {
+
+constexpr Board::BoardMask kBoardMask = OneMask(Board::kBoardSize) - 1;
+constexpr Board::BoardMask kLeftColumn = 0x810204081;
+constexpr Board::BoardMask kRightColumn = kLeftColumn << 6;
+
+// One of the four directions a four-in-a-row can run in. Stepping forward
+// adds kShift to a square's index; stepping backward subtracts it. A step
+// that runs off the left or right edge of the board would wrap around to
+// the other edge, so the squares it would land on are masked off.
+template <int kShift, Board::BoardMask kForwardMask,
+          Board::BoardMask kBackwardMask>
+struct Direction {
+  static constexpr Board::BoardMask Forward(Board::BoardMask mask) {
+    return (mask << kShift) & kForwardMask;
+  }
+  static constexpr Board::BoardMask Backward(Board::BoardMask mask) {
+    return (mask >> kShift) & kBackwardMask;
   }
 
-  return result;
+  // The squares that would make four in a row with three squares of
+  // board, whether or not they are empty.
+  static constexpr Board::BoardMask Holes(Board::BoardMask board) {
+    const Board::BoardMask f1 = Forward(board);
+    const Board::BoardMask f2 = Forward(f1);
+    const Board::BoardMask f3 = Forward(f2);
+    const Board::BoardMask b1 = Backward(board);
+    const Board::BoardMask b2 = Backward(b1);
+    const Board::BoardMask b3 = Backward(b2);
+    return (f1 & f2 & f3) | (f1 & f2 & b1) | (f1 & b1 & b2) | (b1 & b2 & b3);
+  }
+
+  static constexpr bool HasFour(Board::BoardMask board) {
+    const Board::BoardMask pairs = board & Forward(board);
+    return (pairs & Forward(Forward(pairs))) != 0;
+  }
+};
+
+using Horizontal = Direction<1, kBoardMask & ~kLeftColumn,
+                             kBoardMask & ~kRightColumn>;
+using Vertical = Direction<Board::kNumCols, kBoardMask, kBoardMask>;
+using UpRight = Direction<Board::kNumCols + 1, kBoardMask & ~kLeftColumn,
+                          kBoardMask & ~kRightColumn>;
+using UpLeft = Direction<Board::kNumCols - 1, kBoardMask & ~kRightColumn,
+                         kBoardMask & ~kLeftColumn>;
+
+}  // namespace
+
+bool HasFourInARow(Board::BoardMask board) {
+  return Horizontal::HasFour(board) || Vertical::HasFour(board) ||
+         UpRight::HasFour(board) || UpLeft::HasFour(board);
 }
 
-Board::Outcome Board::Position::IsGameOver() const {
+Board::Outcome FindOutcome(Board::BoardMask red_set,
+                           Board::BoardMask yellow_set) {
+  if (HasFourInARow(red_set)) {
+    return Board::Outcome::kRedWins;
+  }
+  if (HasFourInARow(yellow_set)) {
+    return Board::Outcome::kYellowWins;
+  }
+  // Still contested if either player could fill some line.
+  if (HasFourInARow(kBoardMask & ~yellow_set) ||
+      HasFourInARow(kBoardMask & ~red_set)) {
+    return Board::Outcome::kContested;
+  }
+  return Board::Outcome::kDraw;
+}
+
+Board::Outcome ReferenceFindOutcome(Board::BoardMask red_set,
+                                    Board::BoardMask yellow_set) {
   Board::Outcome result = Board::Outcome::kDraw;
   for (Board::BoardMask mask : all_winning_masks) {
     if ((red_set & mask) == mask) {
-      result = Outcome::kRedWins;
+      result = Board::Outcome::kRedWins;
       break;
     }
     if ((yellow_set & mask) == mask) {
-      result = Outcome::kYellowWins;
+      result = Board::Outcome::kYellowWins;
       break;
     }
     if ((red_set & mask) == 0 || (yellow_set & mask) == 0) {
-      result = Outcome::kContested;
+      result = Board::Outcome::kContested;
     }
   }
 
   return result;
 }
 
+int ReferenceScore(Board::BoardMask mine, Board::BoardMask theirs) {
+  int result = 0;
+  for (const Board::BoardMask mask : all_winning_masks) {
+    const int my_count = std::popcount(mine & mask);
+    const int their_count = std::popcount(theirs & mask);
+    result += kLineScore[my_count][their_count];
+  }
+  return result;
+}
+
 // For debugging
 std::string DumpMask(Board::BoardMask mask) {
   std::ostringstream stream;
@@ -411,6 +457,12 @@ std::string DumpMask(Board::BoardMask mask) {
 }
 
 Board::BoardMask FindTriples(const Board::BoardMask &board) {
+  return (Horizontal::Holes(board) | Vertical::Holes(board) |
+          UpRight::Holes(board) | UpLeft::Holes(board)) &
+         kBoardMask & ~board;
+}
+
+Board::BoardMask ReferenceFindTriples(const Board::BoardMask &board) {
   Board::BoardMask result = 0;
   for (const Board::BoardMask mask : all_winning_masks) {
     const Board::BoardMask four_bits = mask & board;
@@ -427,7 +479,8 @@ Board::BoardMask FindTriples(const Board::BoardMask &board) {
 Board::BoardMask FindNewTriples(const Board::BoardMask &board,
                                 Board::BoardMask move) {
   Board::BoardMask result = 0;
-  for (const Board::BoardMask mask : all_partial_wins[std::countr_zero(move)]) {
+  for (const std::size_t i : all_partial_wins[std::countr_zero(move)]) {
+    const Board::BoardMask mask = all_winning_masks[i];
     const Board::BoardMask four_bits = mask & board;
     if (std::popcount(four_bits) == 3) {
       // Find the hole in the three bits.
@@ -454,6 +507,26 @@ Board::BoardMask Board::Position::LegalMoves() const {
   return legal_moves;
 }
 
+std::uint64_t Board::Position::Key() const {
+  const BoardMask occupied = red_set | yellow_set;
+  const BoardMask mine =
+      std::popcount(occupied) % 2 == 0 ? red_set : yellow_set;
+  constexpr BoardMask kBottomRow = OneMask(kNumCols) - 1;
+  return mine | (((occupied << kNumCols) | kBottomRow) & ~occupied);
+}
+
+std::uint64_t Board::Position::CanonicalKey() const {
+  const std::uint64_t key = Key();
+  return std::min(key, MirrorMask(key));
+}
+
+Board::Position Board::Position::Mirror() const {
+  Position result;
+  result.red_set = MirrorMask(red_set);
+  result.yellow_set = MirrorMask(yellow_set);
+  return result;
+}
+
 std::pair<Board::BoardMask, Board::ThreeKind> ThreeInARow(
     unsigned int me, Board::BoardMask red_triples,
     Board::BoardMask yellow_triples, Board::BoardMask legal_moves) {
@@ -493,44 +566,33 @@ std::pair<Board::BoardMask, Board::ThreeKind> Board::Position::ThreeInARow(
 }
 
 int Board::heuristic() const {
-  const unsigned int other = 3 - favorite_;
-  bool four_for_me = false;
-  bool four_for_him = false;
-  int score = 0;
-  combos([other, &four_for_me, &four_for_him, &score, this](Coord a, Coord b,
-                                                            Coord c, Coord d) {
-    const unsigned int ac = get_value(a.first, a.second);
-    const unsigned int bc = get_value(b.first, b.second);
-    const unsigned int cc = get_value(c.first, c.second);
-    const unsigned int dc = get_value(d.first, d.second);
-
-    const int mine = (ac == favorite_) + (bc == favorite_) + (cc == favorite_) +
-                     (dc == favorite_);
-    const int theirs =
-        (ac == other) + (bc == other) + (cc == other) + (dc == other);
-
-    if (mine > 0 && theirs > 0) {
-      return;
-    }
-
-    if (mine == 4) {
-      four_for_me = true;
-    }
-    if (theirs == 4) {
-      four_for_him = true;
-    }
-    if (mine > 0) {
-      score += mine;
-    }
-    if (theirs > 0) {
-      score -= theirs;
-    }
-  });
-
-  return four_for_me ? 1000 : four_for_him ? -1000 : score;
+  const int my_fours = favorite_ == 1 ? red_fours_ : yellow_fours_;
+  const int their_fours = favorite_ == 1 ? yellow_fours_ : red_fours_;
+  if (my_fours != 0) {
+    return 1000;
+  }
+  if (their_fours != 0) {
+    return -1000;
+  }
+  return favorite_ == 1 ? score_ : -score_;
 }
 
 std::size_t Board::find_move(std::size_t depth) {
+  if (book_ != nullptr && whose_turn_ == favorite_) {
+    Position position;
+    position.red_set = red_set_;
+    position.yellow_set = yellow_set_;
+    if (const auto found = book_->Lookup(position);
+        found.has_value() && found->move != 0) {
+      // All the moves are equally good. Play the one nearest the center.
+      for (const std::size_t col : {3, 2, 4, 1, 5, 0, 6}) {
+        if ((found->move & (column_mask << col)) != 0) {
+          return col;
+        }
+      }
+    }
+  }
+
   int alpha = std::numeric_limits<int>::min();
   const int beta = std::numeric_limits<int>::max();
   int value = std::numeric_limits<int>::min();
@@ -538,15 +600,18 @@ std::size_t Board::find_move(std::size_t depth) {
   // The value returned if there are no legal moves.
   std::size_t best_move = std::numeric_limits<std::size_t>::max();
 
-  const std::vector<std::size_t> moves(legal_moves());
-  for (const std::size_t col : moves) {
+  const BoardMask legal_moves = LegalMoves();
+  for (std::size_t col = 0; col < kNumCols; ++col) {
+    if ((legal_moves & (column_mask << col)) == 0) {
+      continue;
+    }
     push(col);
-    const int child = depth == 0
-                          ? heuristic()
-                          : alpha_beta_helper(depth - 1, alpha, beta, false);
+    const int child_value =
+        depth == 0 ? heuristic()
+                   : alpha_beta_helper(depth - 1, alpha, beta, false);
     pop();
-    if (child > value) {
-      value = child;
+    if (child_value > value) {
+      value = child_value;
       best_move = col;
     }
     if (value > alpha) {
@@ -560,28 +625,33 @@ std::size_t Board::find_move(std::size_t depth) {
 // https://en.wikipedia.org/wiki/Alpha%E2%80%93beta_pruning#Improvements_over_naive_minimax
 int Board::alpha_beta_helper(std::size_t depth, int alpha, int beta,
                              bool maximizing) {
-  const std::vector<std::size_t> moves(legal_moves());
-  if (depth == 0 || moves.empty()) {
+  if (depth == 0) {
     return heuristic();
   }
-  switch (IsGameOver()) {
-    case Outcome::kRedWins:
-      return favorite_ == 1 ? 1000 : -1000;
-    case Outcome::kYellowWins:
-      return favorite_ == 2 ? 1000 : -1000;
-    case Outcome::kDraw:
-      return 0;
-    case Outcome::kContested:
-      break;
+  const BoardMask legal_moves = LegalMoves();
+  if (legal_moves == 0) {
+    return heuristic();
+  }
+  if (red_fours_ != 0) {
+    return favorite_ == 1 ? 1000 : -1000;
+  }
+  if (yellow_fours_ != 0) {
+    return favorite_ == 2 ? 1000 : -1000;
   }
 
-  if (maximizing) {
-    int value = std::numeric_limits<int>::min();
-    for (const std::size_t col : moves) {
-      push(col);
-      const int child = alpha_beta_helper(depth - 1, alpha, beta, false);
-      pop();
-
+  // The center columns are usually best, and trying them first leads to
+  // more cutoffs. The order does not change the value, only how quickly
+  // it is found.
+  int value = maximizing ? std::numeric_limits<int>::min()
+                         : std::numeric_limits<int>::max();
+  for (const std::size_t col : {3, 2, 4, 1, 5, 0, 6}) {
+    if ((legal_moves & (column_mask << col)) == 0) {
+      continue;
+    }
+    push(col);
+    const int child = alpha_beta_helper(depth - 1, alpha, beta, !maximizing);
+    pop();
+    if (maximizing) {
       if (child > value) {
         value = child;
       }
@@ -591,15 +661,7 @@ int Board::alpha_beta_helper(std::size_t depth, int alpha, int beta,
       if (value > alpha) {
         alpha = value;
       }
-    }
-    return value;
-  } else {
-    int value = std::numeric_limits<int>::max();
-    for (const std::size_t col : moves) {
-      push(col);
-      const int child = alpha_beta_helper(depth - 1, alpha, beta, true);
-      pop();
-
+    } else {
       if (child < value) {
         value = child;
       }
@@ -610,12 +672,8 @@ int Board::alpha_beta_helper(std::size_t depth, int alpha, int beta,
         beta = value;
       }
     }
-    return value;
   }
-}
-
-Metric Board::Reverse(Metric metric) {
-  return Metric(Reverse(metric.result), metric.depth);
+  return value;
 }
 
 const char *DebugImage(Board::ThreeKind c) {
@@ -803,364 +861,32 @@ Board::Position Board::ParsePosition(const std::string image) {
   return b;
 }
 
-Board::BruteForceReturn4 Board::BruteForce(Board::Position position) {
-  // The returned result.
-  BoardMask best_move = 0;
-
-  struct StackFrame {
-    StackFrame(Position position, unsigned int whose_turn,
-               BoardMask legal_moves, BoardMask red_triples,
-               BoardMask yellow_triples, Metric cutoff, Metric accum)
-        : position(position),
-          whose_turn(whose_turn),
-          legal_moves(legal_moves),
-          best(BruteForceResult::kNil, 0),  // Negative infinity.
-          red_triples(red_triples),
-          yellow_triples(yellow_triples),
-          cutoff(cutoff),
-          accum(accum) {}
-
-    // Input parameter
-    Position position;
-
-    // Redundant with position.
-    unsigned int whose_turn;  // 1 or 2
-
-    BoardMask legal_moves;
-
-    BoardMask moves[kNumCols];
-    std::size_t num_moves;
-    std::size_t current_move = 0;
-
-    Metric best;
-
-    BoardMask red_triples, yellow_triples;
-
-    // Otherwise known as the alpha and beta in Alpha-beta pruning.
-    // Alpha-beta pruning significantly speeds up the search algorithm.
-    // We use a variation on the classic algorithm found at
-    // https://en.wikipedia.org/wiki/Alpha-beta_pruning#Pseudocode
-    // so that we can use the same code to evaluate the position of
-    // either player.
-    Metric cutoff, accum;
-  };
-  std::vector<StackFrame> restack;  // The recursion stack.
-  restack.reserve(kBoardSize);
-
-  const auto stack_trace = [&restack]() {
-    std::cout << "**** Stack Trace ****\n";
-    for (std::size_t i = 0; i < restack.size(); ++i) {
-      const StackFrame &top = restack[i];
-      std::cout << std::format("Level {} {}/{}\n{}-------------\n", i,
-                               top.current_move, top.num_moves,
-                               top.position.image());
-    }
-  };
-
-  const auto stack_path = [&restack]() -> std::string {
-    std::ostringstream stream;
-    bool needs_dot = false;
-    for (const auto &frame : restack) {
-      if (needs_dot) {
-        stream << ".";
+Board::Position Board::ParseHexImage(const std::string &image) {
+  // Two 11-digit hex numbers separated by a dash.
+  if (image.size() != 11 + 1 + 11 || image[11] != '-') {
+    throw std::runtime_error("hex image format");
+  }
+  const auto parse_mask = [&image](std::size_t offset) -> BoardMask {
+    BoardMask result = 0;
+    for (std::size_t i = offset; i < offset + 11; ++i) {
+      const char c = image[i];
+      BoardMask digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        digit = c - 'a' + 10;
       } else {
-        needs_dot = true;
+        throw std::runtime_error("bad hex digit");
       }
-      stream << frame.current_move;
+      result = (result << 4) | digit;
     }
-    return stream.str();
-  };
-
-#define CACHING 1
-
-#if CACHING
-  struct CacheKey {
-    CacheKey() {}
-    CacheKey(Position position, Metric cutoff, Metric accum)
-        : position(position), cutoff(cutoff), accum(accum) {}
-
-    bool operator==(const CacheKey &) const = default;
-    CacheKey &operator=(const CacheKey &) = default;
-
-    // The hash of CacheKey used by the hash table in Cache
-    std::uint64_t hash() {
-      const std::uint64_t bits18 =
-          static_cast<std::uint64_t>(cutoff.result) ^ (cutoff.depth << 3) ^
-          (static_cast<std::uint64_t>(accum.result) << 9) ^ (accum.depth << 12);
-
-      const std::uint64_t bits46 =
-          GoldenHash((GoldenHash(position.red_set) & 0xFFFFFFFF00000000) |
-                     (GoldenHash(position.yellow_set) >> 32));
-      return GoldenHash((bits46 >> 18) | (bits18 << 46)) >> 25;
+    if (result >= OneMask(kBoardSize)) {
+      throw std::runtime_error("hex image out of range");
     }
-
-    Position position;
-    Metric cutoff;
-    Metric accum;
-  };
-
-  Cache<CacheKey, Metric> cache(120000, 100000);
-  std::size_t cache_count = 0;
-  std::size_t cache_hits = 0;
-
-  const auto cache_stats = [&cache, &cache_count, &cache_hits]() {
-    std::cout << std::format("Cached {} values\nFinal size {}\nCache hits {}\n",
-                             cache_count, cache.size(), cache_hits);
+    return result;
   };
-#endif
-
-  try {
-    // This variable is read at report_result.
-    Metric result;
-
-    // These variables are read at the beginning of the loop.
-    // They should not be referenced elsewhere.
-    Board::Position new_pos = position;
-    unsigned int new_whose_turn = GetWhoseTurn(new_pos);
-    BoardMask new_legal_moves = position.LegalMoves();
-    BoardMask new_red_triples = FindTriples(position.red_set);
-    BoardMask new_yellow_triples = FindTriples(position.yellow_set);
-
-    Metric new_cutoff(BruteForceResult::kInf, 0);  // Negative infinity
-    Metric new_accum(BruteForceResult::kNil, 0);   // Positive infinity.
-
-    // Used to report progress (during development).
-    std::size_t timer = 0;
-    static constexpr std::size_t kBlipTime = 100000000;
-    //                        max 18446744073709551615
-
-    for (;;) {
-#if CACHING
-      {
-        // See if the answer is already in the cache.
-        // If so, proceed directly to report_result.
-        // Note that report_result expects a reversed metric.
-        // So when we cache values, we alway cache the metric after
-        // it has been reversed.
-        const auto found =
-            cache.Lookup(CacheKey(new_pos, new_cutoff, new_accum));
-
-        if (found.has_value()) {
-          ++cache_hits;
-          result = *found;
-          goto report_result;
-        }
-      }
-#endif
-
-      {
-        // Evaluate new_pos and new_whose_turn.
-        // If new_pos is warranted, a new stack frame is created,
-        // and the input values are used to create it.
-
-        Board::BoardMask my_triples;
-        Board::BoardMask his_triples;
-        switch (new_whose_turn) {
-          case 1:
-            my_triples = new_red_triples;
-            his_triples = new_yellow_triples;
-            break;
-          case 2:
-            my_triples = new_yellow_triples;
-            his_triples = new_red_triples;
-            break;
-          default:
-            throw std::runtime_error(
-                std::format("Bad value {}", new_whose_turn));
-        }
-
-        // See if I can win.
-        if (const BoardMask winning_move = my_triples & new_legal_moves;
-            winning_move != 0) {
-          if (restack.empty()) {
-            return Board::BruteForceReturn4(BruteForceResult::kWin,
-                                            winning_move);
-          }
-
-          // Reverse the polarity.
-          result.result = BruteForceResult::kLose;
-          result.depth = restack.size();
-
-#if CACHING
-          ++cache_count;
-          *cache.GetOrAdd(CacheKey(new_pos, new_cutoff, new_accum)) = result;
-#endif
-          goto report_result;
-        }
-
-        // See if I have a forced block or loss
-        const BoardMask move = his_triples & new_legal_moves;
-        if (move == 0 || std::popcount(move) == 1) {
-          // None or Block
-          restack.emplace_back(new_pos, new_whose_turn, new_legal_moves,
-                               new_red_triples, new_yellow_triples, new_cutoff,
-                               new_accum);
-          StackFrame &top = restack.back();
-
-          // Initialize top.num_moves and top.moves.
-          if (move == 0) {
-            // Extract the legal moves from new_legal_moves.
-            top.num_moves = 0;
-            for (BoardMask col : ordered_columns) {
-              const BoardMask legal_move = new_legal_moves & col;
-              if (legal_move != 0) {
-                top.moves[top.num_moves++] = legal_move;
-              }
-            }
-          } else {
-            // The only move is the forced block.
-            top.num_moves = 1;
-            top.moves[0] = move;
-          }
-          goto advance_top;
-        }
-
-        // Lose
-        if (restack.empty()) {
-          return Board::BruteForceReturn4(BruteForceResult::kLose, move);
-        }
-
-        // Reverse the polarity.
-        result.result = BruteForceResult::kWin;
-        result.depth = restack.size();
-#if CACHING
-        ++cache_count;
-        *cache.GetOrAdd(CacheKey(new_pos, new_cutoff, new_accum)) = result;
-#endif
-        // Fall into report_result
-      }
-
-    report_result: {
-      StackFrame &top = restack.back();
-      if (top.current_move == 0) {
-        throw std::runtime_error(std::format("current move equals zero"));
-      }
-      const BoardMask move = top.moves[top.current_move - 1];
-      switch (compare(result, top.best)) {
-        case 1:  // result is better
-          top.best = result;
-          if (restack.size() == 1) {
-            best_move = move;
-          }
-
-          // Don't bother updating top.cutoff and top.accum if we are about
-          // to pop the stack.
-
-          // We cannot apply the Alpha/Beta optimization at Level 2.
-          // If we did, we would correctly determine who wins, but
-          // at Level 1 we could produce wrong winning moves.
-          if (restack.size() > 2 && top.current_move < top.num_moves) {
-            if (compare(result, top.cutoff) >= 0) {
-              if (restack.size() == 1) {
-                throw std::runtime_error("Cutoff at level one");
-              }
-
-              result.result = Reverse(result.result);
-              restack.pop_back();
-              goto report_result;
-            }
-            if (compare(result, top.accum) > 0) {
-              top.accum = result;
-            }
-          }
-          break;
-        case 0:  // Both are the same
-          if (restack.size() == 1) {
-            best_move |= move;
-          }
-          break;
-        case -1:  // top.best is better
-          break;
-        default:
-          throw std::runtime_error("Bad compare");
-      }
-      // Fall into advance_top.
-    }
-
-    advance_top: {
-      if (restack.empty()) {
-        throw std::runtime_error("Stack empty");
-      }
-      StackFrame &top = restack.back();
-      if (top.current_move >= top.num_moves) {
-        if (top.best.result == BruteForceResult::kNil) {
-          // There were no legal moves.
-          top.best.result = BruteForceResult::kDraw;
-          top.best.depth = restack.size();
-        }
-        if (restack.size() == 1) {
-          return Board::BruteForceReturn4(top.best.result, best_move);
-        }
-
-        result = Reverse(top.best);
-#if CACHING
-        ++cache_count;
-        *cache.GetOrAdd(CacheKey(top.position, top.cutoff, top.accum)) = result;
-#endif
-
-        restack.pop_back();
-        goto report_result;
-      }
-
-      // Get the next move.
-      const BoardMask move = top.moves[top.current_move++];
-
-      // Apply the next move to to top.position to create a new board
-      // position. Initialize new_pos, and new_whose_turn
-      // so that we can loop back to evaluate this new position.
-      new_pos = top.position;
-      if (top.whose_turn != new_pos.WhoseTurn()) {
-        throw std::runtime_error("turn out of whack\n");
-      }
-#if 0
-      std::cout << "Player " << top.whose_turn << " plays at "
-                << MaskImage(move) << "\nBoard:\n"
-                << new_pos.image();
-#endif
-      // Here is where the heavy lifting happens.
-      // Report progress so we can see how close we are to done.
-      if (++timer >= kBlipTime) {
-        std::cout << stack_path() << "\n";
-        timer = 0;
-      }
-
-      if (top.whose_turn == 1) {
-        new_pos.red_set |= move;
-        new_red_triples =
-            top.red_triples | FindNewTriples(new_pos.red_set, move);
-        new_yellow_triples = top.yellow_triples;
-      } else {
-        new_pos.yellow_set |= move;
-        new_yellow_triples =
-            top.yellow_triples | FindNewTriples(new_pos.yellow_set, move);
-        new_red_triples = top.red_triples;
-      }
-
-      // Update legal_moves to reflect the move just made.
-      static constexpr BoardMask kMoveLimit = OneMask(kBoardSize);
-      new_legal_moves = top.legal_moves & ~(move);
-      if (const BoardMask next_move = move << kNumCols;
-          next_move < kMoveLimit) {
-        new_legal_moves |= next_move;
-      }
-
-      new_whose_turn = 3 - top.whose_turn;
-      if (new_whose_turn != new_pos.WhoseTurn()) {
-        throw std::runtime_error("whose turn?");
-      }
-
-      // Swap cutoff and accum
-      new_cutoff = Reverse(top.accum);
-      new_accum = Reverse(top.cutoff);
-    }
-    }
-  } catch (const std::exception &e) {
-    std::cout << "Exception " << e.what() << "\n";
-    stack_trace();
-    throw;
-  } catch (...) {
-    std::cout << "Unknown exception\n";
-    stack_trace();
-    throw;
-  }
+  Board::Position b;
+  b.red_set = parse_mask(0);
+  b.yellow_set = parse_mask(12);
+  return b;
 }
@@ -6,69 +6,120 @@
 #include <array>
 #include <bit>
 #include <cassert>
+#include <chrono>
 #include <compare>
 #include <cstddef>
 #include <cstdint>
 #include <format>
 #include <functional>
 #include <iostream>
+#include <optional>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
 
+// Whether the search counts what it does (see Board::SearchStats).
+#ifndef C4_SEARCH_STATS
+#define C4_SEARCH_STATS 1
+#endif
+
 // The type returned by BruteForce.
 // kInf and kNil are never returned, but are used internally.
-// Warning: if you change this declaration, also change Board::Reverse.
 enum class BruteForceResult { kInf, kWin, kDraw, kLose, kNil };
 
+// A result, and how many moves it takes. Winners want to win as soon as
+// possible, but losers want to delay the loss as much as possible. The
+// depth of a draw does not matter.
 struct Metric {
   // Any valid metric is better than this:
-  Metric() : result(BruteForceResult::kNil), depth(0) {}
+  constexpr Metric() : result(BruteForceResult::kNil), depth(0) {}
   bool operator==(const Metric &) const = default;
 
-  Metric(BruteForceResult result, std::size_t depth)
+  constexpr Metric(BruteForceResult result, std::size_t depth)
       : result(result), depth(depth) {}
 
-  // Determines which Metric is better.
-  // Like a spaceship operator, but the result can be used in a switch
-  // statement.
-  //
-  // +1: lhs is better
-  //  0: both are the same
-  // -1: rhs is better
-  friend int compare(const Metric& lhs, const Metric& rhs) {
-    const std::strong_ordering compare_result = lhs.result <=> rhs.result;
-    if (compare_result == std::strong_ordering::less) {
-      return 1;  // lhs is better
-    }
-    if (compare_result == std::strong_ordering::equal) {
-      // Break ties with stack depth.
-      // Note: winners want to win as soon as possible,
-      // but losers want to delay the loss as much as possible.
-      const std::strong_ordering compare_depth = lhs.depth <=> rhs.depth;
-      switch (lhs.result) {
-        case BruteForceResult::kWin:
-          return compare_depth == std::strong_ordering::less    ? 1
-                 : compare_depth == std::strong_ordering::equal ? 0
-                                                                : -1;
-        case BruteForceResult::kLose:
-          return compare_depth == std::strong_ordering::less    ? -1
-                 : compare_depth == std::strong_ordering::equal ? 0
-                                                                : 1;
-        default:
-          return 0;  // Stack depth is ignored for ties (and kNil?).
-                     // The depth of ties should all be the same, anyway,
-      }
-    }
-    return -1;  // rhs is better
-  }
-
   BruteForceResult result;
   std::size_t depth;
 };
 
+// A Metric as a single small integer, which is how the search handles
+// values: comparing two Scores is comparing the integers, and seeing one
+// from the other player's point of view is negating it. A win is
+// positive and a loss negative, and the sooner the win, or the later the
+// loss, the higher the score. Every draw scores zero.
+using Score = int;
+
+// Depths never exceed kMaxScoreDepth (the number of squares, plus one),
+// so every Score fits in a byte.
+constexpr std::size_t kMaxScoreDepth = 6 * 7 + 1;
+
+// A win right away. A win or loss at depth d scores d less or more.
+constexpr Score kWinScore = kMaxScoreDepth + 1;
+
+// Better and worse than any Score, like kInf and kNil.
+constexpr Score kInfScore = kWinScore + 1;
+constexpr Score kNilScore = -kInfScore;
+
+constexpr Score WinScore(std::size_t depth) {
+  return kWinScore - static_cast<Score>(depth);
+}
+
+constexpr Score LossScore(std::size_t depth) {
+  return static_cast<Score>(depth) - kWinScore;
+}
+
+constexpr Score ToScore(const Metric& metric) {
+  switch (metric.result) {
+    case BruteForceResult::kInf:
+      return kInfScore;
+    case BruteForceResult::kWin:
+      return WinScore(metric.depth);
+    case BruteForceResult::kDraw:
+      return 0;
+    case BruteForceResult::kLose:
+      return LossScore(metric.depth);
+    default:
+      return kNilScore;
+  }
+}
+
+// Draws come back with a depth of zero.
+constexpr Metric ToMetric(Score score) {
+  if (score >= kInfScore) {
+    return Metric(BruteForceResult::kInf, 0);
+  }
+  if (score <= kNilScore) {
+    return Metric();
+  }
+  if (score > 0) {
+    return Metric(BruteForceResult::kWin, kWinScore - score);
+  }
+  if (score < 0) {
+    return Metric(BruteForceResult::kLose, score + kWinScore);
+  }
+  return Metric(BruteForceResult::kDraw, 0);
+}
+
+// Determines which Metric is better.
+// Like a spaceship operator, but the result can be used in a switch
+// statement.
+//
+// +1: lhs is better
+//  0: both are the same
+// -1: rhs is better
+inline int compare(const Metric& lhs, const Metric& rhs) {
+  const Score lhs_score = ToScore(lhs);
+  const Score rhs_score = ToScore(rhs);
+  return (lhs_score > rhs_score) - (lhs_score < rhs_score);
+}
+
 std::ostream& operator<<(std::ostream& os, const Metric& metric);
 
+class OpeningBook;
+class SolvedStore;
+class TranspositionTable;
+
 class Board {
  public:
   // A Board is a 6x7 matrix of values.
@@ -111,12 +162,32 @@ class Board {
     // Returns all the places where a piece can be legally played.
     BoardMask LegalMoves() const;
 
+    // Returns a 49-bit number that identifies the position: the pieces of
+    // the player to move, plus the lowest empty square in each column,
+    // counting a seventh row above the board for full columns. Since the
+    // pieces in a column are stacked, the topmost bit in each column marks
+    // its height, and the bits below it say whose pieces are there.
+    std::uint64_t Key() const;
+
+    // The same, but a position and its mirror image have the same key.
+    std::uint64_t CanonicalKey() const;
+
+    // Returns the position reflected left to right.
+    Position Mirror() const;
+
+    bool IsSymmetric() const { return *this == Mirror(); }
+
     // Overload that computes the red_triples and yellow_triples.
     std::pair<Board::BoardMask, Board::ThreeKind> ThreeInARow(
         unsigned int me) const;
 
     std::string image() const;
 
+    // The same format as Board::HexImage.
+    std::string HexImage() const {
+      return std::format("{:011x}-{:011x}", red_set, yellow_set);
+    }
+
     // Each of these is 48 bits, numbered rowwise.
     // "red" is player 1 and "yellow" is player 2.
     BoardMask red_set = 0;
@@ -125,6 +196,9 @@ class Board {
 
   static Position ParsePosition(const std::string image);
 
+  // The inverse of HexImage.
+  static Position ParseHexImage(const std::string& image);
+
   Board() { clear(); }
 
   Board(const Board&) = default;
@@ -184,24 +258,42 @@ class Board {
       std::function<void(Coord a, Coord b, Coord c, Coord d)> visit);
 
   // Uses alpha-beta-minimax to find the best possible move using the
-  // search depth.
+  // search depth. If the position is in the book, plays a move from the
+  // book instead.
   std::size_t find_move(std::size_t depth);
 
+  // The book is not owned, and must outlive the board. May be null.
+  void set_book(const OpeningBook* book) { book_ = book; }
+
   // The number of possible 4-in-a-row positions on the board.
   static constexpr std::size_t kNumFours = 69;
   using MaskArray = std::array<BoardMask, kNumFours>;
 
-  // Computes the winning masks at program startup.
-  static MaskArray winning_masks();
+  // Computes the winning masks at compile time, in the order that combos
+  // visits them.
+  static constexpr MaskArray winning_masks();
 
-  static BoardMask CreateColumnMask();
+  // Computes a mask with a 1 in every row of the leftmost column.
+  static constexpr BoardMask CreateColumnMask();
 
-  // A map from the board position to the winning_masks that include that
-  // position.
-  using PartialWins = std::array<std::vector<std::size_t>, kBoardSize>;
+  // The most four-in-a-rows that can include a single square.
+  static constexpr std::size_t kMaxPartialWins = 16;
 
-  // Computes SomeName at program startup.
-  static PartialWins ComputePartialWins();
+  // A map from the board position to the indices of the winning_masks
+  // that include that position. Fixed-size, so that it can be built at
+  // compile time.
+  struct PartialWins {
+    constexpr std::span<const std::uint8_t> operator[](
+        std::size_t position) const {
+      return {indices[position].data(), counts[position]};
+    }
+
+    std::array<std::array<std::uint8_t, kMaxPartialWins>, kBoardSize> indices;
+    std::array<std::uint8_t, kBoardSize> counts;
+  };
+
+  // Computes the PartialWins at compile time.
+  static constexpr PartialWins ComputePartialWins();
 
   // Returns a string representation of the board.
   std::string image() const;
@@ -222,24 +314,265 @@ class Board {
     BoardMask move;
   };
 
+  // Solves position, returning the result for the player to move and all
+  // the moves that achieve it.
   static BruteForceReturn4 BruteForce(Board::Position position);
 
+  // The same, but remembers positions in the given table, which may
+  // already hold results from earlier searches.
+  static BruteForceReturn4 BruteForce(Board::Position position,
+                                      TranspositionTable &table);
+
+  // How BruteForce divides the work among several threads.
+  enum class Parallelism {
+    // Every thread searches the whole tree, trying the moves in a
+    // slightly different order, and the first one to finish has the
+    // answer. The threads cooperate only through the table.
+    kLazySmp,
+
+    // One thread searches the tree. Once it has searched the first move
+    // at a node, the other threads may help it with the remaining moves
+    // (the "young brothers wait" rule). A cutoff cancels the helpers.
+    kSplit,
+  };
+
+  // How BruteForce chooses which move to search first at each node.
+  // Alpha-beta pruning only pays off if a good move is searched early.
+  enum class MoveOrdering {
+    // Center columns first, then the ones further out.
+    kStatic,
+
+    // The move the table remembers as best for the position first, then
+    // the two moves that most recently caused cutoffs at the same depth
+    // (the "killers"), then the rest in order of how many cutoffs they
+    // have caused anywhere (the "history"), with ties going to the
+    // center. So far this has not beaten kStatic: the center columns are
+    // hard to improve on, and the history often leads away from them.
+    kHistory,
+
+    // The moves that make the most new threats first, with ties going to
+    // the center. A threat is an empty square that would complete a
+    // four-in-a-row for the player who made it. This searches three or
+    // four times fewer nodes than kStatic.
+    kThreats,
+  };
+
+  // Whether the search keeps SearchStats. If not, the counting is compiled
+  // out, and the stats stay zero. Set with -DC4_SEARCH_STATS=0.
+  static constexpr bool kSearchStats = C4_SEARCH_STATS;
+
+  // What happened during a search, for measuring the move ordering and
+  // the table, and for seeing where the time goes.
+  struct SearchStats {
+    // Positions whose moves were searched, and the number of those where
+    // the only move was a forced block.
+    std::uint64_t nodes = 0;
+    std::uint64_t forced_blocks = 0;
+
+    // Positions decided without searching, because the player to move
+    // can win at once, or cannot stop the other player from winning.
+    std::uint64_t immediate_wins = 0;
+    std::uint64_t forced_losses = 0;
+
+    // Nodes cut off before all their moves were searched, by the depth of
+    // the node, and by the index of the move that caused the cutoff in
+    // the order the moves were searched. The more cutoffs by move zero,
+    // the better the ordering.
+    std::uint64_t cutoffs = 0;
+    std::array<std::uint64_t, kBoardSize + 1> cutoffs_by_depth = {};
+    std::array<std::uint64_t, kNumCols> cutoffs_by_move = {};
+
+    // Positions looked up in the transposition table, and the number of
+    // those the table decided, so that they did not need searching.
+    std::uint64_t table_probes = 0;
+    std::uint64_t table_hits = 0;
+
+    // Bounds stored in the table, and the number of those that replaced
+    // an entry for another position.
+    std::uint64_t table_stores = 0;
+    std::uint64_t table_evictions = 0;
+
+    // The deepest the search went, in moves from the position searched.
+    std::size_t max_depth = 0;
+
+    // The time spent in searches.
+    double seconds = 0;
+
+    double NodesPerSecond() const {
+      return seconds == 0 ? 0 : nodes / seconds;
+    }
+
+    SearchStats &operator+=(const SearchStats &other) {
+      nodes += other.nodes;
+      forced_blocks += other.forced_blocks;
+      immediate_wins += other.immediate_wins;
+      forced_losses += other.forced_losses;
+      cutoffs += other.cutoffs;
+      for (std::size_t i = 0; i < cutoffs_by_depth.size(); ++i) {
+        cutoffs_by_depth[i] += other.cutoffs_by_depth[i];
+      }
+      for (std::size_t i = 0; i < cutoffs_by_move.size(); ++i) {
+        cutoffs_by_move[i] += other.cutoffs_by_move[i];
+      }
+      table_probes += other.table_probes;
+      table_hits += other.table_hits;
+      table_stores += other.table_stores;
+      table_evictions += other.table_evictions;
+      max_depth = std::max(max_depth, other.max_depth);
+      seconds += other.seconds;
+      return *this;
+    }
+  };
+
+  struct BruteForceOptions {
+    // The number of threads that search the position at the same time.
+    // They share the table, and each one benefits from what the others
+    // have stored in it. The result does not depend on the number of
+    // threads.
+    unsigned int num_threads = 1;
+
+    Parallelism parallelism = Parallelism::kLazySmp;
+
+    // If not null, positions in the book are looked up, not searched.
+    const OpeningBook *book = nullptr;
+
+    // If not null, positions in the store are looked up, not searched,
+    // and BruteForce adds the positions it solves to it.
+    SolvedStore *store = nullptr;
+
+    MoveOrdering ordering = MoveOrdering::kThreats;
+
+    // Whether each search starts by marking the entries already in the
+    // table as old (see TranspositionTable::NewSearch). Turn this off when
+    // several searches share the table at once, and age it once for all
+    // of them instead, or each one ages the entries the others are using.
+    bool new_search = true;
+
+    // If not null, the counts for the search are added to it, summed
+    // over all the threads. Stays zero unless kSearchStats.
+    SearchStats *stats = nullptr;
+  };
+
+  static BruteForceReturn4 BruteForce(Board::Position position,
+                                      TranspositionTable &table,
+                                      const BruteForceOptions &options);
+
+  // The answer of Solve.
+  struct SolveResult {
+    BruteForceResult result;
+    BoardMask move;
+
+    // Whether result is certain. If so, every move in move achieves it,
+    // although a win may also be had more slowly by other moves. If not,
+    // the deadline came first, and result and move are the best guess of
+    // the deepest search that finished, which scored the positions it
+    // could not see past as draws.
+    bool proven;
+
+    // How many moves ahead that search looked.
+    std::size_t depth;
+  };
+
+  // Solves position as far as it can before deadline. Searches one move
+  // deeper at a time, keeping the answer of the last search to finish,
+  // and stops early once the result is proven. Always finishes at least
+  // the one-move search, however soon the deadline.
+  static SolveResult Solve(Board::Position position,
+                           std::chrono::steady_clock::time_point deadline);
+
+  // The same, with a table that may already hold results of earlier
+  // searches.
+  static SolveResult Solve(Board::Position position,
+                           TranspositionTable &table,
+                           std::chrono::steady_clock::time_point deadline,
+                           const BruteForceOptions &options);
+
+  // Finds just the result for the player to move, not the moves that
+  // achieve it. Rather than searching with the widest possible window,
+  // as BruteForce does, asks yes-or-no questions such as "is it at least
+  // a draw?" with null-window searches, which prune far more.
+  static BruteForceResult ProveResult(Board::Position position,
+                                      TranspositionTable &table,
+                                      const BruteForceOptions &options);
+
+  // The same, but goes on to find how quickly the game is won or lost,
+  // with more null-window searches that bisect the possible depths.
+  static Metric ProveValue(Board::Position position,
+                           TranspositionTable &table,
+                           const BruteForceOptions &options);
+
  private:
+  // What a search needs to know besides the position: which thread is
+  // running it, whether to give up, and who might help. Defined in
+  // search.cc.
+  struct SearchContext;
+
+  // How much of the tree a search may look at.
+  struct SearchLimits {
+    // Nodes less than this deep are never pruned, which BruteForce needs
+    // to find all the best moves at the root.
+    std::size_t exact_levels = 0;
+
+    // If not zero, positions this deep are not searched, but scored as
+    // draws.
+    std::size_t horizon = 0;
+
+    // If not null, where the bounds that depend on the horizon are kept.
+    // The main table only gets the ones that do not. Must be cleared
+    // whenever the horizon changes.
+    TranspositionTable *horizon_table = nullptr;
+
+    // If set, the search gives up once this time has passed.
+    std::optional<std::chrono::steady_clock::time_point> deadline =
+        std::nullopt;
+  };
+
+  struct SearchResult {
+    Score value;  // For the player to move.
+
+    // The moves that achieve value. Only meaningful at level zero.
+    BoardMask best_move;
+
+    // False if value depends on positions beyond the horizon.
+    bool proven = true;
+  };
+
+  // The driver for ProveResult and ProveValue.
+  static Metric Prove(Board::Position position, TranspositionTable &table,
+                      const BruteForceOptions &options, bool result_only);
+
+  // Searches position with the given window, using as many threads as
+  // options ask for. Returns nothing if the deadline in limits passes
+  // before the search completes.
+  static std::optional<SearchResult> SearchRoot(
+      Board::Position position, TranspositionTable &table,
+      const BruteForceOptions &options, Score cutoff, Score accum,
+      const SearchLimits &limits);
+
+  // Searches the subtree below position with the given window. The level
+  // is the number of moves between the root of the whole search and
+  // position, and is needed because Score depths are measured from the
+  // root. Returns nothing if the context is cancelled or the deadline
+  // passes before the search completes.
+  static std::optional<SearchResult> Search(Board::Position position,
+                                            TranspositionTable &table,
+                                            SearchContext &context,
+                                            std::size_t level, Score cutoff,
+                                            Score accum);
+
   // The recursive function that performs alpha-beta minimax restricted
-  // to the given depth.
+  // to the given depth. Plays the moves with push and pop, which keep the
+  // heuristic up to date as they go, so nothing is allocated and the
+  // leaves cost next to nothing.
   int alpha_beta_helper(std::size_t depth, int alpha, int beta,
                         bool maximizing);
 
-  // To use the same code to evaluate either player, we need to reverse
-  // results as we pass them between levels. One player's good news is
-  // the other player's bad news.
-  static BruteForceResult Reverse(BruteForceResult result) {
-    // Apology: this is brittle code, but it is a performance hot spot.
-    return static_cast<BruteForceResult>(4 - static_cast<std::size_t>(result));
+  // The columns that are not full, as a mask of the squares where a piece
+  // would land.
+  BoardMask LegalMoves() const {
+    return Position{red_set_, yellow_set_}.LegalMoves();
   }
 
-  static Metric Reverse(Metric metric);
-
   // Each of these is 48 bits, numbered rowwise.
   // "red" is player 1 and "yellow" is player 2.
   BoardMask red_set_ = 0;
@@ -251,6 +584,23 @@ class Board {
     std::uint8_t yellow_count;
   };
 
+  // Adds (delta = 1) or removes (delta = -1) player's piece at index,
+  // updating the counts and the score of every four-in-a-row through it.
+  void Count(int index, unsigned int player, int delta);
+
+  // The pieces in each four-in-a-row, indexed as in winning_masks. Kept
+  // up to date as pieces are added and removed, so that heuristic only
+  // has to look at the totals below.
+  PieceCounts counts_[kNumFours] = {};
+
+  // The heuristic from red's point of view, leaving out the 1000 points
+  // for four in a row.
+  int score_ = 0;
+
+  // The number of four-in-a-rows that each player has completed.
+  int red_fours_ = 0;
+  int yellow_fours_ = 0;
+
   struct Data {
     BoardMask red_set;
     BoardMask yellow_set;
@@ -263,12 +613,42 @@ class Board {
 
   // The payer we want to win.
   unsigned int favorite_ = 1;
+
+  const OpeningBook* book_ = nullptr;
 };
 
+static_assert(kMaxScoreDepth == Board::kBoardSize + 1);
+
 // Finds all occurences of three of four bits in board.
 // Add the mask for the missing fourth bit into the result.
+// Shifts the whole board in each direction at once, rather than looking
+// at the four-in-a-rows one by one.
 Board::BoardMask FindTriples(const Board::BoardMask& board);
 
+// Whether board has four in a row, found the same way.
+bool HasFourInARow(Board::BoardMask board);
+
+// The outcome of a game with the given pieces, as in Board::IsGameOver.
+Board::Outcome FindOutcome(Board::BoardMask red_set,
+                           Board::BoardMask yellow_set);
+
+// The same as FindTriples and FindOutcome, but looping over all the
+// four-in-a-rows. Much slower, but obviously right, so the tests check the
+// fast versions against them.
+Board::BoardMask ReferenceFindTriples(const Board::BoardMask& board);
+Board::Outcome ReferenceFindOutcome(Board::BoardMask red_set,
+                                    Board::BoardMask yellow_set);
+
+// The score that Board::heuristic keeps up to date, computed from scratch:
+// for each four-in-a-row, the number of pieces of mine if it has none of
+// theirs, less the number of theirs if it has none of mine.
+int ReferenceScore(Board::BoardMask mine, Board::BoardMask theirs);
+
+// The same as FindTriples, but only considers the four-in-a-rows that
+// include move.
+Board::BoardMask FindNewTriples(const Board::BoardMask& board,
+                                Board::BoardMask move);
+
 // Searches for supported three-in-a-rows. "Supported" means the fourth
 // square is empty, and the square below it is occupied or nonexistent.
 // If found, returns the moves needed to make or block four-in-a-row.
@@ -282,6 +662,77 @@ constexpr Board::BoardMask OneMask(std::size_t index) {
   return UINT64_C(1) << index;
 }
 
+constexpr Board::MaskArray Board::winning_masks() {
+  MaskArray result{};
+  std::size_t i = 0;
+  // Adds the four-in-a-row starting at (row, col) and going in the
+  // direction (row_step, col_step).
+  const auto add = [&i, &result](int row, int col, int row_step,
+                                 int col_step) {
+    BoardMask mask = 0;
+    for (int j = 0; j < 4; ++j) {
+      mask |= OneMask((row + j * row_step) * kNumCols + col + j * col_step);
+    }
+    result[i++] = mask;
+  };
+  for (int row = 0; row < 6; ++row) {
+    for (int col = 0; col <= 3; ++col) {
+      add(row, col, 0, 1);
+    }
+  }
+  for (int row = 0; row <= 2; ++row) {
+    for (int col = 0; col < 7; ++col) {
+      add(row, col, 1, 0);
+    }
+  }
+  for (int row = 0; row <= 2; ++row) {
+    for (int col = 0; col <= 3; ++col) {
+      add(row, col, 1, 1);
+    }
+  }
+  for (int row = 0; row <= 2; ++row) {
+    for (int col = 3; col < 7; ++col) {
+      add(row, col, 1, -1);
+    }
+  }
+  return result;
+}
+
+constexpr Board::BoardMask Board::CreateColumnMask() {
+  BoardMask result = 0;
+  for (std::size_t index = 0; index < kBoardSize; index += kNumCols) {
+    result |= OneMask(index);
+  }
+  return result;
+}
+
+constexpr Board::PartialWins Board::ComputePartialWins() {
+  PartialWins result{};
+  // Invert the winning masks.
+  // For every 1 bit in winning_masks()[i], append i into the indices
+  // corresponding to the position of that bit.
+  const MaskArray masks = winning_masks();
+  for (std::size_t i = 0; i < masks.size(); ++i) {
+    for (std::size_t j = 0; j < kBoardSize; ++j) {
+      if ((masks[i] >> j) & 1) {
+        result.indices[j][result.counts[j]++] = static_cast<std::uint8_t>(i);
+      }
+    }
+  }
+  return result;
+}
+
+// Reflects mask left to right. Rows above the top of the board are
+// reflected too, so this also works on a Position::Key.
+constexpr Board::BoardMask MirrorMask(Board::BoardMask mask) {
+  // The leftmost column, extended to nine rows.
+  constexpr Board::BoardMask kLeft = 0x0102040810204081;
+  return ((mask & kLeft) << 6) | ((mask >> 6) & kLeft) |
+         ((mask & (kLeft << 1)) << 4) | ((mask >> 4) & (kLeft << 1)) |
+         ((mask & (kLeft << 2)) << 2) | ((mask >> 2) & (kLeft << 2)) |
+         (mask & (kLeft << 3));
+}
+
 std::string MaskImage(Board::BoardMask mask);
 std::string MaskMap(Board::BoardMask mask);
 
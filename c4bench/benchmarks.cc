@@ -0,0 +1,242 @@
+// A Google Benchmark suite for the kernels the search is built on and for
+// whole solves of the positions in the tests, so that a change can be
+// judged by numbers rather than by the comments in test.cc.
+//
+// Usage: c4benchmarks [--benchmark_filter=REGEX] [--benchmark_format=json]
+//                     [--benchmark_out=FILE --benchmark_out_format=json]
+//
+// The kernel benchmarks run over the positions of random games, and
+// report the time per call. The table benchmarks probe and store in a
+// table a quarter, half or entirely full of random positions, which is
+// where the search spends much of its time. The BruteForce benchmarks
+// solve a position from an empty table each iteration, and also report
+// the nodes searched per solve and the nodes per second (these are zero
+// if the library was built with C4_SEARCH_STATS=0). The slowest of them,
+// CurrentLimit, takes about half a second per solve; HyperExpensive is
+// left out.
+
+#include <benchmark/benchmark.h>
+
+#include <bit>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "../board.h"
+#include "../transposition_table.h"
+#include "random_games.h"
+
+namespace {
+
+constexpr std::size_t kNumPositions = 10000;
+
+const std::vector<RandomPosition> &Positions() {
+  static const std::vector<RandomPosition> positions =
+      RandomPositions(kNumPositions);
+  return positions;
+}
+
+// Calls kernel on each of the Positions in turn.
+template <typename Kernel>
+void RunKernel(benchmark::State &state, Kernel kernel) {
+  const std::vector<RandomPosition> &positions = Positions();
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(kernel(positions[i]));
+    if (++i == positions.size()) {
+      i = 0;
+    }
+  }
+}
+
+void BM_FindTriples(benchmark::State &state) {
+  RunKernel(state, [](const RandomPosition &p) {
+    return FindTriples(p.position.red_set);
+  });
+}
+BENCHMARK(BM_FindTriples);
+
+void BM_FindNewTriples(benchmark::State &state) {
+  RunKernel(state, [](const RandomPosition &p) {
+    return FindNewTriples(p.mover_set(), p.last_move);
+  });
+}
+BENCHMARK(BM_FindNewTriples);
+
+void BM_LegalMoves(benchmark::State &state) {
+  RunKernel(state,
+            [](const RandomPosition &p) { return p.position.LegalMoves(); });
+}
+BENCHMARK(BM_LegalMoves);
+
+void BM_IsGameOver(benchmark::State &state) {
+  RunKernel(state,
+            [](const RandomPosition &p) { return p.position.IsGameOver(); });
+}
+BENCHMARK(BM_IsGameOver);
+
+// Board::heuristic is kept up to date by push and pop, so this measures
+// all three: each iteration plays one move of a random game and scores
+// the board, and takes the game back at the end.
+void BM_PushHeuristicPop(benchmark::State &state) {
+  static const std::vector<std::vector<std::size_t>> games =
+      RandomGames(kNumPositions);
+  Board board;
+  board.set_favorite(1);
+  std::size_t game = 0;
+  std::size_t move = 0;
+  for (auto _ : state) {
+    board.push(games[game][move]);
+    benchmark::DoNotOptimize(board.heuristic());
+    if (++move == games[game].size()) {
+      for (; move > 0; --move) {
+        board.pop();
+      }
+      if (++game == games.size()) {
+        game = 0;
+      }
+    }
+  }
+}
+BENCHMARK(BM_PushHeuristicPop);
+
+// The size of the table in the table benchmarks, the same as the
+// search's.
+constexpr std::size_t kTableMegabytes = TranspositionTable::kDefaultMegabytes;
+
+// Positions enough to fill that table twice over.
+const std::vector<RandomPosition> &TablePositions() {
+  static const std::vector<RandomPosition> positions = RandomPositions(
+      2 * TranspositionTable(kTableMegabytes).capacity());
+  return positions;
+}
+
+// A table with entries for the first state.range(0) percent as many
+// TablePositions as it can hold, which is the number that Fill returns.
+std::size_t Fill(benchmark::State &state, TranspositionTable &table) {
+  const std::vector<RandomPosition> &positions = TablePositions();
+  const std::size_t count = table.capacity() * state.range(0) / 100;
+  const TranspositionTable::Bounds draw(0, 0);
+  for (std::size_t i = 0; i < count; ++i) {
+    table.Store(positions[i].position, 0, draw,
+                std::countr_zero(positions[i].last_move) % Board::kNumCols);
+  }
+  return count;
+}
+
+// Probes for the positions in the table, each in turn, or for their
+// mirror images if mirror is set, which find the same entries by the
+// other path. Some probes miss, where the position was replaced.
+void BM_TableProbe(benchmark::State &state, bool mirror) {
+  TranspositionTable table(kTableMegabytes);
+  const std::size_t count = Fill(state, table);
+  const std::vector<RandomPosition> &positions = TablePositions();
+  std::vector<Board::Position> probes;
+  for (std::size_t i = 0; i < count; ++i) {
+    probes.push_back(mirror ? positions[i].position.Mirror()
+                            : positions[i].position);
+  }
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.Probe(probes[i], 0));
+    if (++i == probes.size()) {
+      i = 0;
+    }
+  }
+}
+BENCHMARK_CAPTURE(BM_TableProbe, Position, false)->Arg(25)->Arg(50)->Arg(100);
+BENCHMARK_CAPTURE(BM_TableProbe, Mirror, true)->Arg(25)->Arg(50)->Arg(100);
+
+// Stores new positions in a table that is already that full, so that at
+// the higher fills most stores replace an entry.
+void BM_TableStore(benchmark::State &state) {
+  TranspositionTable table(kTableMegabytes);
+  const std::size_t count = Fill(state, table);
+  const std::vector<RandomPosition> &positions = TablePositions();
+  const TranspositionTable::Bounds draw(0, 0);
+  std::size_t i = count;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.Store(positions[i].position, 0, draw));
+    if (++i == positions.size()) {
+      i = count;
+    }
+  }
+}
+BENCHMARK(BM_TableStore)->Arg(25)->Arg(50)->Arg(100);
+
+// Solves image from an empty table each iteration.
+void BM_BruteForce(benchmark::State &state, const std::string &image) {
+  const Board::Position position = Board::ParsePosition(image);
+  TranspositionTable table;
+  Board::SearchStats stats;
+  Board::BruteForceOptions options;
+  options.stats = &stats;
+  for (auto _ : state) {
+    state.PauseTiming();
+    table.Clear();
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(Board::BruteForce(position, table, options));
+  }
+  state.counters["nodes"] = benchmark::Counter(
+      static_cast<double>(stats.nodes), benchmark::Counter::kAvgIterations);
+  state.counters["nodes_per_second"] = benchmark::Counter(
+      static_cast<double>(stats.nodes), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK_CAPTURE(BM_BruteForce, TempTest, std::string(R"(
+...1...
+2..2...
+11.2.1.
+12.1.2.
+112221.
+2111222
+)"))->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_BruteForce, ExpensiveTest, std::string(R"(
+...1...
+...2...
+.1.2.1.
+.2.1.2.
+1122.1.
+2111222
+)"))->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_BruteForce, Simple, std::string(R"(
+....211
+....122
+2...211
+1..2122
+2.11212
+1121122
+)"))->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_BruteForce, YellowWins, std::string(R"(
+2......
+1.....1
+2.....1
+1...212
+2212121
+1112212
+)"))->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_BruteForce, OneMore4, std::string(R"(
+...1...
+...21..
+.2.22.1
+.1.12.2
+22.2111
+1112122
+)"))->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_BruteForce, CurrentLimit, std::string(R"(
+.......
+...1...
+..122..
+..211.2
+..122.1
+..211.2
+)"))->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
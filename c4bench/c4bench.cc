@@ -0,0 +1,114 @@
+// Measures the kernels that test a board against the four-in-a-rows.
+//
+// Usage: c4bench [--positions=N] [--rounds=N]
+//
+// Plays N random games' worth of positions, then times each version of
+// FindTriples, FindOutcome and the heuristic score over all of them, and
+// writes the average time per call:
+//
+//   loop     the reference versions, one four-in-a-row at a time
+//   shift    the shift-based versions the search uses
+//   vector   the AVX2 versions (or their scalar fallbacks; see HaveAvx2)
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../board.h"
+#include "../vector_kernel.h"
+#include "random_games.h"
+
+namespace {
+
+// Calls kernel on every position, rounds times, and returns the average
+// time per call in nanoseconds. The results are added into sink, so
+// that the calls cannot be optimized away.
+template <typename Kernel>
+double Time(const std::vector<RandomPosition> &positions,
+            std::size_t rounds, std::uint64_t &sink, Kernel kernel) {
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t round = 0; round < rounds; ++round) {
+    for (const RandomPosition &random : positions) {
+      sink += static_cast<std::uint64_t>(kernel(random.position));
+    }
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / (rounds * positions.size());
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::size_t num_positions = 100000;
+  std::size_t rounds = 20;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    static const std::string kPositions = "--positions=";
+    static const std::string kRounds = "--rounds=";
+    if (arg.starts_with(kPositions)) {
+      num_positions = std::stoul(arg.substr(kPositions.size()));
+    } else if (arg.starts_with(kRounds)) {
+      rounds = std::stoul(arg.substr(kRounds.size()));
+    } else {
+      std::cerr << "unknown argument " << arg << "\n";
+      return 1;
+    }
+  }
+
+  const std::vector<RandomPosition> positions =
+      RandomPositions(num_positions);
+  std::uint64_t sink = 0;
+  const auto report = [](const std::string &name, double loop, double shift,
+                         double vector) {
+    std::cout << std::format("{:<10} {:>8.2f} {:>8.2f} {:>8.2f}\n", name, loop,
+                             shift, vector);
+  };
+
+  std::cout << std::format("AVX2: {}\n", HaveAvx2() ? "yes" : "no");
+  std::cout << std::format("{:<10} {:>8} {:>8} {:>8}   (ns per call)\n", "",
+                           "loop", "shift", "vector");
+  report(
+      "triples",
+      Time(positions, rounds, sink,
+           [](const Board::Position &p) {
+             return ReferenceFindTriples(p.red_set);
+           }),
+      Time(positions, rounds, sink,
+           [](const Board::Position &p) { return FindTriples(p.red_set); }),
+      Time(positions, rounds, sink, [](const Board::Position &p) {
+        return VectorFindTriples(p.red_set);
+      }));
+  report(
+      "outcome",
+      Time(positions, rounds, sink,
+           [](const Board::Position &p) {
+             return ReferenceFindOutcome(p.red_set, p.yellow_set);
+           }),
+      Time(positions, rounds, sink,
+           [](const Board::Position &p) {
+             return FindOutcome(p.red_set, p.yellow_set);
+           }),
+      Time(positions, rounds, sink, [](const Board::Position &p) {
+        return VectorFindOutcome(p.red_set, p.yellow_set);
+      }));
+  // There is no shift-based score; the search keeps it up to date as it
+  // goes instead (see Board::heuristic).
+  report("score",
+         Time(positions, rounds, sink,
+              [](const Board::Position &p) {
+                return ReferenceScore(p.red_set, p.yellow_set);
+              }),
+         0,
+         Time(positions, rounds, sink, [](const Board::Position &p) {
+           return VectorScore(p.red_set, p.yellow_set);
+         }));
+
+  // Print the sink, so that none of the work can be skipped.
+  std::cerr << std::format("checksum {:x}\n", sink);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// Random games to measure the kernels on, shared by c4bench and the
+// benchmark suite.
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "../board.h"
+
+// Plays random games until they add up to at least num_moves moves, and
+// returns the columns played in each. The same every time.
+inline std::vector<std::vector<std::size_t>> RandomGames(
+    std::size_t num_moves) {
+  std::mt19937_64 random(1);
+  const Board::BoardMask column_mask = Board::CreateColumnMask();
+  std::vector<std::vector<std::size_t>> result;
+  std::size_t total = 0;
+  while (total < num_moves) {
+    std::vector<std::size_t> &game = result.emplace_back();
+    Board::Position position;
+    unsigned int whose_turn = 1;
+    while (position.IsGameOver() == Board::Outcome::kContested) {
+      const Board::BoardMask legal_moves = position.LegalMoves();
+      std::size_t column;
+      Board::BoardMask move = 0;
+      while (move == 0) {
+        column = random() % Board::kNumCols;
+        move = legal_moves & (column_mask << column);
+      }
+      (whose_turn == 1 ? position.red_set : position.yellow_set) |= move;
+      whose_turn = 3 - whose_turn;
+      game.push_back(column);
+    }
+    total += game.size();
+  }
+  return result;
+}
+
+// A position from a random game, and the move that reached it.
+struct RandomPosition {
+  Board::Position position;
+  Board::BoardMask last_move;
+
+  // The pieces of the player who made last_move.
+  Board::BoardMask mover_set() const {
+    return (position.red_set & last_move) != 0 ? position.red_set
+                                               : position.yellow_set;
+  }
+};
+
+// Returns the first count positions reached in the RandomGames.
+inline std::vector<RandomPosition> RandomPositions(std::size_t count) {
+  const Board::BoardMask column_mask = Board::CreateColumnMask();
+  std::vector<RandomPosition> result;
+  for (const std::vector<std::size_t> &game : RandomGames(count)) {
+    Board::Position position;
+    unsigned int whose_turn = 1;
+    for (const std::size_t column : game) {
+      const Board::BoardMask move =
+          position.LegalMoves() & (column_mask << column);
+      (whose_turn == 1 ? position.red_set : position.yellow_set) |= move;
+      whose_turn = 3 - whose_turn;
+      result.push_back(RandomPosition{position, move});
+    }
+  }
+  result.resize(count);
+  return result;
+}
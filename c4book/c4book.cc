@@ -0,0 +1,121 @@
+// Builds an opening book for OpeningBook.
+//
+// Usage: c4book --plies=N [--megabytes=N] [--threads=N] [--split] output
+//
+// Solves every position that can arise in the first N moves of a game
+// (counting a position and its mirror image once) and writes the
+// solutions to output. The positions with the most pieces are solved
+// first, so that the transposition table is full of their results by the
+// time the harder positions above them are searched.
+//
+// The work grows steeply with N: a handful of plies is a long job, even
+// with many threads.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../board.h"
+#include "../opening_book.h"
+#include "../transposition_table.h"
+
+namespace {
+
+// Returns the positions after each number of moves, up to max_plies,
+// leaving out finished games and mirror images.
+std::vector<std::vector<Board::Position>> Enumerate(std::size_t max_plies) {
+  std::vector<std::vector<Board::Position>> result(max_plies + 1);
+  result[0].push_back(Board::Position());
+  const Board::BoardMask column_mask = Board::CreateColumnMask();
+  for (std::size_t ply = 1; ply <= max_plies; ++ply) {
+    std::set<std::uint64_t> seen;
+    for (const Board::Position &parent : result[ply - 1]) {
+      const Board::BoardMask legal_moves = parent.LegalMoves();
+      for (std::size_t col = 0; col < Board::kNumCols; ++col) {
+        const Board::BoardMask move = legal_moves & (column_mask << col);
+        if (move == 0) {
+          continue;
+        }
+        Board::Position child = parent;
+        if (parent.WhoseTurn() == 1) {
+          child.red_set |= move;
+        } else {
+          child.yellow_set |= move;
+        }
+        if (child.IsGameOver() == Board::Outcome::kContested &&
+            seen.insert(child.CanonicalKey()).second) {
+          result[ply].push_back(child);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+constexpr char kUsage[] =
+    "Usage: c4book --plies=N [--megabytes=N] [--threads=N] [--split] "
+    "output\n";
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::optional<std::size_t> plies;
+  std::size_t megabytes = 1024;
+  Board::BruteForceOptions options;
+  std::string output;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    static const std::string kPlies = "--plies=";
+    static const std::string kMegabytes = "--megabytes=";
+    static const std::string kThreads = "--threads=";
+    if (arg.starts_with(kPlies)) {
+      plies = std::stoul(arg.substr(kPlies.size()));
+    } else if (arg.starts_with(kMegabytes)) {
+      megabytes = std::stoul(arg.substr(kMegabytes.size()));
+    } else if (arg.starts_with(kThreads)) {
+      options.num_threads = std::stoul(arg.substr(kThreads.size()));
+    } else if (arg == "--split") {
+      options.parallelism = Board::Parallelism::kSplit;
+    } else if (output.empty() && !arg.starts_with("--")) {
+      output = arg;
+    } else {
+      std::cerr << kUsage;
+      return 1;
+    }
+  }
+  if (output.empty()) {
+    std::cerr << "c4book: no output file\n";
+    return 1;
+  }
+  if (!plies.has_value()) {
+    std::cerr << kUsage;
+    return 1;
+  }
+
+  try {
+    const auto positions = Enumerate(*plies);
+    TranspositionTable table(megabytes);
+    OpeningBook::Writer writer;
+    for (std::size_t ply = *plies + 1; ply-- > 0;) {
+      const auto start = std::chrono::steady_clock::now();
+      for (const Board::Position &position : positions[ply]) {
+        writer.Add(position, Board::BruteForce(position, table, options));
+      }
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      std::clog << "Ply " << ply << ": " << positions[ply].size()
+                << " positions in " << elapsed.count() << " sec\n";
+    }
+    writer.Write(output, *plies);
+  } catch (const std::exception &e) {
+    std::cerr << "c4book: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,304 @@
+// Checks that a change has not broken the solver or made it slower.
+//
+// Usage: c4regress [--corpus=FILE] [--baseline=FILE] [--megabytes=N]
+//                  [--repeat=N] [--node-tolerance=PCT]
+//                  [--time-tolerance=PCT] [--no-times] [--write-baseline]
+//
+// Solves each position in the corpus (by default c4regress/corpus.txt)
+// with Board::BruteForce, on one thread, from an empty table of N
+// megabytes, and checks the result and the best moves against the ones
+// the corpus gives. A corpus line is
+//
+//   <name> <hex image> <result> <columns>
+//
+// in the format c4solve writes, with a name in front. Blank lines and
+// lines starting with '#' are ignored.
+//
+// Then it compares the nodes searched and the time taken with the
+// baseline (by default c4regress/baseline.txt), one line per position:
+//
+//   <name> <nodes> <milliseconds>
+//
+// A position regresses if it searches more than PCT percent more nodes
+// than the baseline (zero by default, since the count only changes when
+// the search does), or takes more than PCT percent longer (25 by
+// default) plus a couple of milliseconds for the noise in the clock. Each
+// position is solved --repeat times (3 by default), and the fastest time
+// counts. With --no-times, only the nodes are compared, which gives the
+// same answer on any machine. The node counts depend on the size of the
+// table, so use the same --megabytes as the baseline. They are not
+// compared if the library was built with C4_SEARCH_STATS=0.
+//
+// Exits with 1 if any answer is wrong or any position regresses. With
+// --write-baseline, writes what it measured to the baseline instead of
+// comparing, after checking the answers. The times in the baseline are
+// only good for the machine that wrote them.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../board.h"
+#include "../transposition_table.h"
+
+namespace {
+
+// Time differences this small are noise.
+constexpr double kTimeSlackMilliseconds = 2;
+
+struct CorpusEntry {
+  std::string name;
+  Board::Position position;
+  BruteForceResult result;
+  Board::BoardMask move;
+};
+
+struct Measurement {
+  std::uint64_t nodes = 0;
+  double milliseconds = 0;
+};
+
+BruteForceResult ParseResult(const std::string &text) {
+  for (const BruteForceResult result :
+       {BruteForceResult::kWin, BruteForceResult::kDraw,
+        BruteForceResult::kLose}) {
+    if (text == DebugImage(result)) {
+      return result;
+    }
+  }
+  throw std::runtime_error(std::format("bad result {}", text));
+}
+
+// Returns the moves to the columns in text, a list like "2,4", or "-"
+// for none.
+Board::BoardMask ParseColumns(const std::string &text,
+                              const Board::Position &position) {
+  if (text == "-") {
+    return 0;
+  }
+  const Board::BoardMask column_mask = Board::CreateColumnMask();
+  Board::BoardMask result = 0;
+  std::istringstream stream(text);
+  std::string column;
+  while (std::getline(stream, column, ',')) {
+    const std::size_t col = std::stoul(column);
+    const Board::BoardMask move =
+        col < Board::kNumCols ? position.LegalMoves() & (column_mask << col)
+                              : 0;
+    if (move == 0) {
+      throw std::runtime_error(std::format("bad column {}", column));
+    }
+    result |= move;
+  }
+  return result;
+}
+
+// Calls visit with the words of each line of the file at path that is not
+// blank or a comment. Throws if the file cannot be read, or if visit
+// throws, adding the file and line to the message.
+template <typename Visit>
+void ReadLines(const std::string &path, Visit visit) {
+  std::ifstream input(path);
+  if (!input) {
+    throw std::runtime_error(std::format("{}: cannot open", path));
+  }
+  std::string line;
+  std::size_t line_number = 0;
+  while (std::getline(input, line)) {
+    ++line_number;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream stream(line);
+    std::vector<std::string> words;
+    for (std::string word; stream >> word;) {
+      words.push_back(word);
+    }
+    try {
+      visit(words);
+    } catch (const std::exception &e) {
+      throw std::runtime_error(
+          std::format("{}:{}: {}", path, line_number, e.what()));
+    }
+  }
+}
+
+std::vector<CorpusEntry> ReadCorpus(const std::string &path) {
+  std::vector<CorpusEntry> result;
+  ReadLines(path, [&result](const std::vector<std::string> &words) {
+    if (words.size() != 4) {
+      throw std::runtime_error("expected name, position, result and columns");
+    }
+    const Board::Position position = Board::ParseHexImage(words[1]);
+    if (position.IsGameOver() != Board::Outcome::kContested) {
+      throw std::runtime_error("the game is already over");
+    }
+    result.push_back(CorpusEntry{words[0], position, ParseResult(words[2]),
+                                 ParseColumns(words[3], position)});
+  });
+  return result;
+}
+
+std::map<std::string, Measurement> ReadBaseline(const std::string &path) {
+  std::map<std::string, Measurement> result;
+  ReadLines(path, [&result](const std::vector<std::string> &words) {
+    if (words.size() != 3) {
+      throw std::runtime_error("expected name, nodes and milliseconds");
+    }
+    result[words[0]] =
+        Measurement{std::stoull(words[1]), std::stod(words[2])};
+  });
+  return result;
+}
+
+// The change from base to value, as a percentage.
+double PercentChange(double value, double base) {
+  return base == 0 ? 0.0 : 100.0 * (value - base) / base;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::string corpus_path = "c4regress/corpus.txt";
+  std::string baseline_path = "c4regress/baseline.txt";
+  std::size_t megabytes = 64;
+  std::size_t repeat = 3;
+  double node_tolerance = 0;
+  double time_tolerance = 25;
+  bool compare_times = true;
+  bool write_baseline = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    static const std::string kCorpus = "--corpus=";
+    static const std::string kBaseline = "--baseline=";
+    static const std::string kMegabytes = "--megabytes=";
+    static const std::string kRepeat = "--repeat=";
+    static const std::string kNodeTolerance = "--node-tolerance=";
+    static const std::string kTimeTolerance = "--time-tolerance=";
+    if (arg.starts_with(kCorpus)) {
+      corpus_path = arg.substr(kCorpus.size());
+    } else if (arg.starts_with(kBaseline)) {
+      baseline_path = arg.substr(kBaseline.size());
+    } else if (arg.starts_with(kMegabytes)) {
+      megabytes = std::stoul(arg.substr(kMegabytes.size()));
+    } else if (arg.starts_with(kRepeat)) {
+      repeat = std::max<std::size_t>(std::stoul(arg.substr(kRepeat.size())),
+                                     1);
+    } else if (arg.starts_with(kNodeTolerance)) {
+      node_tolerance = std::stod(arg.substr(kNodeTolerance.size()));
+    } else if (arg.starts_with(kTimeTolerance)) {
+      time_tolerance = std::stod(arg.substr(kTimeTolerance.size()));
+    } else if (arg == "--no-times") {
+      compare_times = false;
+    } else if (arg == "--write-baseline") {
+      write_baseline = true;
+    } else {
+      std::cerr << "unknown argument " << arg << "\n";
+      return 1;
+    }
+  }
+
+  std::vector<CorpusEntry> corpus;
+  std::map<std::string, Measurement> baseline;
+  try {
+    corpus = ReadCorpus(corpus_path);
+    if (!write_baseline) {
+      baseline = ReadBaseline(baseline_path);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  TranspositionTable table(megabytes);
+  std::size_t failures = 0;
+  std::vector<Measurement> measurements;
+  for (const CorpusEntry &entry : corpus) {
+    Measurement measured;
+    Board::BruteForceReturn4 solution;
+    for (std::size_t i = 0; i < repeat; ++i) {
+      table.Clear();
+      Board::SearchStats stats;
+      Board::BruteForceOptions options;
+      options.stats = &stats;
+      const auto start = std::chrono::steady_clock::now();
+      solution = Board::BruteForce(entry.position, table, options);
+      const std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      measured.nodes = stats.nodes;
+      measured.milliseconds = i == 0 ? elapsed.count()
+                                     : std::min(measured.milliseconds,
+                                                elapsed.count());
+    }
+    measurements.push_back(measured);
+
+    std::cout << std::format("{:<24} {:>10} nodes {:>10.2f} ms", entry.name,
+                             measured.nodes, measured.milliseconds);
+    if (solution.result != entry.result || solution.move != entry.move) {
+      std::cout << std::format("  WRONG: {} {}, expected {} {}\n",
+                               DebugImage(solution.result),
+                               MaskImage(solution.move),
+                               DebugImage(entry.result),
+                               MaskImage(entry.move));
+      ++failures;
+      continue;
+    }
+    if (write_baseline) {
+      std::cout << "\n";
+      continue;
+    }
+
+    const auto found = baseline.find(entry.name);
+    if (found == baseline.end()) {
+      std::cout << "  (not in the baseline)\n";
+      continue;
+    }
+    const Measurement &base = found->second;
+    std::cout << std::format("  {:+6.1f}% nodes {:+6.1f}% ms",
+                             PercentChange(measured.nodes, base.nodes),
+                             PercentChange(measured.milliseconds,
+                                           base.milliseconds));
+    if (Board::kSearchStats &&
+        measured.nodes > base.nodes * (1 + node_tolerance / 100)) {
+      std::cout << "  MORE NODES";
+      ++failures;
+    }
+    if (compare_times &&
+        measured.milliseconds > base.milliseconds * (1 + time_tolerance / 100) +
+                                    kTimeSlackMilliseconds) {
+      std::cout << "  SLOWER";
+      ++failures;
+    }
+    std::cout << "\n";
+  }
+
+  if (write_baseline && failures == 0) {
+    std::ofstream output(baseline_path);
+    output << "# Written by c4regress --write-baseline.\n"
+              "# <name> <nodes> <milliseconds>\n";
+    for (std::size_t i = 0; i < corpus.size(); ++i) {
+      output << std::format("{} {} {:.2f}\n", corpus[i].name,
+                            measurements[i].nodes,
+                            measurements[i].milliseconds);
+    }
+    if (!output) {
+      std::cerr << baseline_path << ": cannot write\n";
+      return 1;
+    }
+  }
+  if (failures != 0) {
+    std::cout << std::format("{} failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,404 @@
+// A command-line front end for Board::BruteForce.
+//
+// Usage: c4solve [--megabytes=N] [--threads=N] [--split] [--book=FILE]
+//                [--store=FILE] [--result-only] [--seconds=S]
+//                [--ordering=static|history|threats] [--stats]
+//                [--jobs=N [--private-tables]] [file...]
+//
+// Reads positions from the named files (or stdin if there are none, or
+// if a file is named "-") and writes one line per position to stdout:
+//
+//   <hex image> <result> <columns>
+//
+// where <result> is Win, Draw or Lose from the point of view of the
+// player to move, and <columns> is a comma-separated list of the best
+// moves ("-" if there are none). With --result-only, the columns are
+// left out, and the result is found with Board::ProveResult, which is
+// much faster. With --seconds, each position is given S seconds (see
+// Board::Solve), and a line whose result is a guess rather than a proof
+// ends with "?".
+//
+// A position is either a HexImage, such as
+//   00000000008-00000000400
+// or six lines of seven characters in the ParsePosition format, top row
+// first:
+//   .......
+//   .......
+//   .......
+//   .......
+//   ...2...
+//   ...1...
+// Blank lines and lines starting with '#' are ignored.
+//
+// All the positions share one transposition table of N megabytes, so
+// later positions can reuse what was learned solving earlier ones.
+// With --threads, each position is searched by that many threads at
+// once; the output is the same for any number of threads. By default the
+// threads all search the whole tree (Lazy SMP); with --split they share
+// out the moves at each node instead.
+//
+// With --book, positions in the opening book (see c4book) are looked up
+// rather than solved.
+//
+// With --store, positions in the solved-position store (see SolvedStore)
+// are looked up rather than solved, and the positions that are solved
+// are added to it when all the input has been read. Any number of
+// c4solve processes may share one store.
+//
+// The --ordering flag chooses how moves are ordered at each node (see
+// Board::MoveOrdering). With --stats, the counts for all the positions
+// (see Board::SearchStats) are written to stderr at the end. They are
+// all zero if c4solve was built with C4_SEARCH_STATS=0.
+//
+// With --jobs, all the positions are read first, then solved N at a time
+// by Solver::ParallelSolveBatch, and the lines are written in the order
+// of the input at the end. The jobs share the table unless
+// --private-tables is given, in which case each has one of its own of
+// the same size. With --stats, the rate of search, the table hit rate and
+// the distribution of the time per position are written too.
+
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../board.h"
+#include "../opening_book.h"
+#include "../solved_store.h"
+#include "../solver.h"
+#include "../transposition_table.h"
+
+namespace {
+
+constexpr char kUsage[] =
+    "Usage: c4solve [--megabytes=N] [--threads=N] [--split] [--book=FILE]\n"
+    "               [--store=FILE] [--result-only] [--seconds=S]\n"
+    "               [--ordering=static|history|threats] [--stats]\n"
+    "               [--jobs=N [--private-tables]] [file...]\n";
+
+bool IsHexImage(const std::string &line) {
+  return line.size() == 23 && line[11] == '-';
+}
+
+bool IsBoardRow(const std::string &line) {
+  return line.size() == Board::kNumCols &&
+         line.find_first_not_of(".12") == std::string::npos;
+}
+
+// Returns the columns in mask as a string like "2,4".
+std::string ColumnList(Board::BoardMask mask) {
+  if (mask == 0) {
+    return "-";
+  }
+  bool columns[Board::kNumCols] = {};
+  while (mask != 0) {
+    const int offset = std::countr_zero(mask);
+    columns[offset % Board::kNumCols] = true;
+    mask &= mask - 1;
+  }
+  std::ostringstream stream;
+  bool needs_comma = false;
+  for (std::size_t col = 0; col < Board::kNumCols; ++col) {
+    if (columns[col]) {
+      if (needs_comma) {
+        stream << ",";
+      } else {
+        needs_comma = true;
+      }
+      stream << col;
+    }
+  }
+  return stream.str();
+}
+
+struct Settings {
+  Board::BruteForceOptions options;
+  bool result_only = false;
+  double seconds = 0;  // No time limit.
+  unsigned int jobs = 0;  // Not a batch.
+  Solver::TablePolicy table_policy = Solver::TablePolicy::kShared;
+};
+
+// Throws if position cannot be solved.
+void Check(const Board::Position &position) {
+  if (position.IsGameOver() != Board::Outcome::kContested) {
+    throw std::runtime_error("the game is already over");
+  }
+  // Throws if the piece counts are out of whack.
+  position.WhoseTurn();
+}
+
+void WriteLine(const Board::Position &position,
+               const Board::BruteForceReturn4 &solution) {
+  std::cout << position.HexImage() << " " << DebugImage(solution.result)
+            << " " << ColumnList(solution.move) << std::endl;
+}
+
+// Solves position and writes its result line.
+void Solve(const Board::Position &position, TranspositionTable &table,
+           const Settings &settings) {
+  Check(position);
+
+  if (settings.seconds > 0) {
+    const auto deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(settings.seconds));
+    const Board::SolveResult solved =
+        Board::Solve(position, table, deadline, settings.options);
+    std::cout << position.HexImage() << " " << DebugImage(solved.result)
+              << " " << ColumnList(solved.move) << (solved.proven ? "" : " ?")
+              << std::endl;
+    return;
+  }
+  if (settings.result_only) {
+    const BruteForceResult result =
+        Board::ProveResult(position, table, settings.options);
+    std::cout << position.HexImage() << " " << DebugImage(result)
+              << std::endl;
+    return;
+  }
+  WriteLine(position,
+            Board::BruteForce(position, table, settings.options));
+}
+
+// Calls visit with every position in input, reporting the errors that
+// either of them throws. Returns the number of errors.
+template <typename Visit>
+std::size_t ReadStream(std::istream &input, const std::string &name,
+                       Visit visit) {
+  std::size_t errors = 0;
+  std::size_t line_number = 0;
+  std::string line;
+  const auto report = [&errors, &name, &line_number](const std::string &what) {
+    std::cerr << name << ":" << line_number << ": " << what << "\n";
+    ++errors;
+  };
+
+  while (std::getline(input, line)) {
+    ++line_number;
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    try {
+      if (IsHexImage(line)) {
+        visit(Board::ParseHexImage(line));
+      } else if (IsBoardRow(line)) {
+        // Collect the rest of the rows.
+        std::string image = "\n" + line + "\n";
+        for (std::size_t row = 1; row < Board::kNumRows; ++row) {
+          if (!std::getline(input, line)) {
+            throw std::runtime_error("truncated board");
+          }
+          ++line_number;
+          if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+          }
+          if (!IsBoardRow(line)) {
+            throw std::runtime_error("bad board row");
+          }
+          image += line + "\n";
+        }
+        visit(Board::ParsePosition(image));
+      } else {
+        throw std::runtime_error("unrecognized position");
+      }
+    } catch (const std::exception &e) {
+      report(e.what());
+    }
+  }
+  return errors;
+}
+
+// The percentage that part is of whole.
+double Percent(std::uint64_t part, std::uint64_t whole) {
+  return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+
+// Writes stats to stderr.
+void WriteStats(const Board::SearchStats &stats) {
+  std::cerr << std::format(
+      "nodes {}\nforced blocks {}\nimmediate wins {}\nforced losses {}\n"
+      "max depth {}\nseconds in search {:.3f}\nnodes per second {:.0f}\n",
+      stats.nodes, stats.forced_blocks, stats.immediate_wins,
+      stats.forced_losses, stats.max_depth, stats.seconds,
+      stats.NodesPerSecond());
+  std::cerr << std::format("cutoffs {}\nfirst move cutoffs {} ({:.1f}%)\n",
+                           stats.cutoffs, stats.cutoffs_by_move[0],
+                           Percent(stats.cutoffs_by_move[0], stats.cutoffs));
+  std::cerr << "cutoffs by move";
+  for (const std::uint64_t count : stats.cutoffs_by_move) {
+    std::cerr << " " << count;
+  }
+  std::cerr << "\ncutoffs by depth";
+  for (const std::uint64_t count : stats.cutoffs_by_depth) {
+    std::cerr << " " << count;
+  }
+  std::cerr << std::format(
+      "\ntable probes {}\ntable hits {} ({:.1f}%)\n"
+      "table stores {}\ntable evictions {} ({:.1f}%)\n",
+      stats.table_probes, stats.table_hits,
+      Percent(stats.table_hits, stats.table_probes), stats.table_stores,
+      stats.table_evictions,
+      Percent(stats.table_evictions, stats.table_stores));
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::size_t megabytes = 256;
+  Settings settings;
+  Board::BruteForceOptions &options = settings.options;
+  std::string book_path;
+  std::string store_path;
+  std::vector<std::string> files;
+  Board::SearchStats stats;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    static const std::string kMegabytes = "--megabytes=";
+    static const std::string kThreads = "--threads=";
+    static const std::string kBook = "--book=";
+    static const std::string kStore = "--store=";
+    static const std::string kSeconds = "--seconds=";
+    static const std::string kJobs = "--jobs=";
+    if (arg.starts_with(kMegabytes)) {
+      megabytes = std::stoul(arg.substr(kMegabytes.size()));
+    } else if (arg.starts_with(kThreads)) {
+      options.num_threads = std::stoul(arg.substr(kThreads.size()));
+    } else if (arg == "--split") {
+      options.parallelism = Board::Parallelism::kSplit;
+    } else if (arg.starts_with(kBook)) {
+      book_path = arg.substr(kBook.size());
+    } else if (arg.starts_with(kStore)) {
+      store_path = arg.substr(kStore.size());
+    } else if (arg.starts_with(kSeconds)) {
+      settings.seconds = std::stod(arg.substr(kSeconds.size()));
+    } else if (arg == "--ordering=static") {
+      options.ordering = Board::MoveOrdering::kStatic;
+    } else if (arg == "--ordering=history") {
+      options.ordering = Board::MoveOrdering::kHistory;
+    } else if (arg == "--ordering=threats") {
+      options.ordering = Board::MoveOrdering::kThreats;
+    } else if (arg == "--stats") {
+      options.stats = &stats;
+    } else if (arg == "--result-only") {
+      settings.result_only = true;
+    } else if (arg.starts_with(kJobs)) {
+      settings.jobs = std::stoul(arg.substr(kJobs.size()));
+    } else if (arg == "--private-tables") {
+      settings.table_policy = Solver::TablePolicy::kPrivate;
+    } else if (arg.starts_with("--")) {
+      std::cerr << "c4solve: unknown option " << arg << "\n" << kUsage;
+      return 1;
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (files.empty()) {
+    files.push_back("-");
+  }
+  if (settings.jobs != 0 && (settings.result_only || settings.seconds > 0)) {
+    std::cerr << "--jobs cannot be used with --result-only or --seconds\n";
+    return 1;
+  }
+
+  std::unique_ptr<OpeningBook> book;
+  if (!book_path.empty()) {
+    try {
+      book = std::make_unique<OpeningBook>(book_path);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+    options.book = book.get();
+  }
+  std::unique_ptr<SolvedStore> store;
+  if (!store_path.empty()) {
+    try {
+      store = std::make_unique<SolvedStore>(store_path);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+    options.store = store.get();
+  }
+
+  // Positions are solved as they are read, except in a batch, where they
+  // are collected and solved at the end.
+  std::unique_ptr<TranspositionTable> table;
+  if (settings.jobs == 0) {
+    table = std::make_unique<TranspositionTable>(megabytes);
+  }
+  std::vector<Board::Position> batch;
+  const auto visit = [&table, &settings,
+                      &batch](const Board::Position &position) {
+    if (settings.jobs == 0) {
+      Solve(position, *table, settings);
+    } else {
+      Check(position);
+      batch.push_back(position);
+    }
+  };
+
+  std::size_t errors = 0;
+  for (const std::string &file : files) {
+    if (file == "-") {
+      errors += ReadStream(std::cin, "<stdin>", visit);
+      continue;
+    }
+    std::ifstream input(file);
+    if (!input) {
+      std::cerr << file << ": cannot open\n";
+      ++errors;
+      continue;
+    }
+    errors += ReadStream(input, file, visit);
+  }
+
+  Solver::BatchStats batch_stats;
+  if (settings.jobs != 0) {
+    Solver solver(megabytes, options);
+    const std::vector<Board::BruteForceReturn4> solutions =
+        solver.ParallelSolveBatch(
+            batch,
+            Solver::BatchOptions{.num_threads = settings.jobs,
+                                 .table_policy = settings.table_policy},
+            &batch_stats);
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      WriteLine(batch[i], solutions[i]);
+    }
+  }
+  if (store != nullptr) {
+    try {
+      store->Flush();
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << "\n";
+      ++errors;
+    }
+  }
+  if (options.stats != nullptr) {
+    WriteStats(stats);
+    if (settings.jobs != 0) {
+      std::cerr << std::format(
+          "seconds {:.3f}\nnodes per second {:.0f}\n"
+          "latency p50 {:.3f} p90 {:.3f} p99 {:.3f} max {:.3f}\n",
+          batch_stats.seconds, batch_stats.NodesPerSecond(),
+          batch_stats.Percentile(0.5), batch_stats.Percentile(0.9),
+          batch_stats.Percentile(0.99), batch_stats.Percentile(1));
+    }
+  }
+  return errors == 0 ? 0 : 1;
+}
@@ -1,6 +1,6 @@
 #pragma once
-#include <intrin.h>
 
+#include <bit>
 #include <cstddef>
 #include <cstdint>
 #include <format>
@@ -27,19 +27,10 @@ class Cache {
     if (table_size == 0) {
       throw std::runtime_error("Zero table size");
     }
-    // Surprisingly complicated code to figure out how many bits
-    // are in the largest index for the given table size.
-    unsigned long table_bits;
-    if (table_size == 1) {
-      // The only index is zero. We don't need no stinkin bits.
-      table_bits = 0;
-    } else {
-      // table_size - 1 is the max index.
-      _BitScanReverse64(&table_bits, table_size - 1);
-
-      // Convert from zero-based to 1-based bit indices.
-      ++table_bits;
-    }
+    // The number of bits in the largest index for the given table size.
+    // If table_size is 1, the only index is zero, and we don't need no
+    // stinkin bits.
+    const int table_bits = std::bit_width(table_size - 1);
 
     // In the hash function, we shift away all but the most significant
     // table_bits.
@@ -138,6 +129,7 @@ class Cache {
     }
 
     n->key = key;
+    n->value = Value();
     n->bucket_next = nullptr;
     n->bucket_prev = pred;
     n->id = ++node_counter_;
@@ -0,0 +1,74 @@
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <format>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path) {
+  const HANDLE file =
+      CreateFileA(path.c_str(), GENERIC_READ,
+                  FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                  FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error(std::format("{}: cannot open", path));
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    throw std::runtime_error(std::format("{}: empty or unreadable", path));
+  }
+  mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);  // The mapping keeps the file open.
+  if (mapping_ == nullptr) {
+    throw std::runtime_error(std::format("{}: cannot map", path));
+  }
+  data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (data_ == nullptr) {
+    CloseHandle(mapping_);
+    throw std::runtime_error(std::format("{}: cannot map", path));
+  }
+  size_ = static_cast<std::size_t>(size.QuadPart);
+}
+
+MappedFile::~MappedFile() {
+  UnmapViewOfFile(data_);
+  CloseHandle(mapping_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("{}: cannot open", path));
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size == 0) {
+    close(fd);
+    throw std::runtime_error(std::format("{}: empty or unreadable", path));
+  }
+  size_ = static_cast<std::size_t>(status.st_size);
+  void *const data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);  // The mapping keeps the file open.
+  if (data == MAP_FAILED) {
+    throw std::runtime_error(std::format("{}: cannot map", path));
+  }
+  data_ = data;
+}
+
+MappedFile::~MappedFile() { munmap(const_cast<void *>(data_), size_); }
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A read-only view of a whole file, mapped into memory. The contents are
+// paged in by the operating system as they are touched, and are shared
+// by every process that maps the same file.
+class MappedFile {
+ public:
+  // Throws std::runtime_error if the file cannot be opened or mapped.
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const void *data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+ private:
+  const void *data_ = nullptr;
+  std::size_t size_ = 0;
+
+#ifdef _WIN32
+  void *mapping_ = nullptr;  // The HANDLE of the file mapping object.
+#endif
+};
@@ -0,0 +1,82 @@
+#include "opening_book.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr char kMagic[8] = {'C', '4', 'B', 'O', 'O', 'K', '1', '\0'};
+
+struct Header {
+  char magic[8];
+  std::uint64_t max_plies;
+  std::uint64_t num_records;
+};
+
+}  // namespace
+
+OpeningBook::OpeningBook(const std::string &path) : file_(path) {
+  Header header;
+  if (file_.size() < sizeof(header)) {
+    throw std::runtime_error(std::format("{}: not a book", path));
+  }
+  std::memcpy(&header, file_.data(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      file_.size() !=
+          sizeof(header) + header.num_records * sizeof(std::uint64_t)) {
+    throw std::runtime_error(std::format("{}: not a book", path));
+  }
+  records_ = reinterpret_cast<const std::uint64_t *>(
+      static_cast<const char *>(file_.data()) + sizeof(header));
+  num_records_ = header.num_records;
+  max_plies_ = header.max_plies;
+}
+
+std::optional<Board::BruteForceReturn4> OpeningBook::Lookup(
+    const Board::Position &position) const {
+  const std::uint64_t *const end = records_ + num_records_;
+  const std::uint64_t *const found =
+      FindRecord(records_, end, position.CanonicalKey());
+  if (found == end) {
+    return std::nullopt;
+  }
+  return Board::BruteForceReturn4(RecordValue(*found).result,
+                                  RecordMove(*found, position));
+}
+
+void OpeningBook::Writer::Add(const Board::Position &position,
+                              const Board::BruteForceReturn4 &solution) {
+  records_.push_back(EncodeRecord(position, Metric(solution.result, 0),
+                                  solution.move));
+}
+
+void OpeningBook::Writer::Write(const std::string &path,
+                                std::size_t max_plies) {
+  std::sort(records_.begin(), records_.end());
+  // A position may have been added in both orientations.
+  records_.erase(std::unique(records_.begin(), records_.end(),
+                             [](std::uint64_t a, std::uint64_t b) {
+                               return RecordKey(a) == RecordKey(b);
+                             }),
+                 records_.end());
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.max_plies = max_plies;
+  header.num_records = records_.size();
+
+  std::ofstream output(path, std::ios::binary);
+  output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  output.write(reinterpret_cast<const char *>(records_.data()),
+               records_.size() * sizeof(std::uint64_t));
+  if (!output) {
+    throw std::runtime_error(std::format("{}: cannot write", path));
+  }
+}
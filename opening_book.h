@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "mapped_file.h"
+#include "solved_record.h"
+
+// A file of solved positions, built ahead of time by the c4book tool, so
+// that the positions with the fewest pieces, which take the longest to
+// solve, can be looked up instead.
+//
+// The file is a header followed by a sorted array of 64-bit records, one
+// per position (see solved_record.h), so a lookup is a binary search of
+// the mapped file, with no parsing or copying. Numbers are stored in the
+// byte order of the machine that wrote them.
+class OpeningBook {
+ public:
+  // Maps the book at path into memory. Throws std::runtime_error if it
+  // is not a book.
+  explicit OpeningBook(const std::string &path);
+
+  // Returns the solution of position, in the form BruteForce would, if
+  // position is in the book.
+  std::optional<Board::BruteForceReturn4> Lookup(
+      const Board::Position &position) const;
+
+  // The book holds every position with at most this many pieces.
+  std::size_t max_plies() const { return max_plies_; }
+
+  // The number of positions in the book.
+  std::size_t size() const { return num_records_; }
+
+  // Collects solutions and writes them to a book.
+  class Writer {
+   public:
+    void Add(const Board::Position &position,
+             const Board::BruteForceReturn4 &solution);
+
+    // Throws std::runtime_error if the file cannot be written.
+    void Write(const std::string &path, std::size_t max_plies);
+
+   private:
+    std::vector<std::uint64_t> records_;
+  };
+
+ private:
+  MappedFile file_;
+  const std::uint64_t *records_;
+  std::size_t num_records_;
+  std::size_t max_plies_;
+};
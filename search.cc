@@ -0,0 +1,1216 @@
+// Board::BruteForce and its relatives, which solve a position by
+// searching the game tree below it.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <format>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "opening_book.h"
+#include "solved_store.h"
+#include "transposition_table.h"
+
+namespace {
+
+using ColumnOrder = std::array<Board::BoardMask, Board::kNumCols>;
+
+constexpr std::array<ColumnOrder, 6> CreateColumnOrders() {
+  // Alpha-beta pruning is faster if we are lucky enough to evaluate
+  // a move with a good Score first. This will result in a high accum,
+  // which turns into a low cutoff at the next level, which means
+  // evaluating fewer subtrees.
+  //
+  // We use the crude heuristic that moves in the center of the board
+  // tend to be better than moves at the edges. The first order is the
+  // one we believe in. The others shuffle the three center columns, and
+  // are there to give the helper threads something different to do.
+  constexpr std::array<std::array<int, Board::kNumCols>, 6> shuffles = {{
+      {3, 2, 4, 1, 5, 0, 6},
+      {2, 4, 3, 1, 5, 0, 6},
+      {4, 3, 2, 1, 5, 0, 6},
+      {3, 4, 2, 1, 5, 0, 6},
+      {2, 3, 4, 1, 5, 0, 6},
+      {4, 2, 3, 1, 5, 0, 6},
+  }};
+  constexpr Board::BoardMask column_mask = Board::CreateColumnMask();
+  std::array<ColumnOrder, 6> result{};
+  for (std::size_t i = 0; i < result.size(); ++i) {
+    for (std::size_t j = 0; j < Board::kNumCols; ++j) {
+      result[i][j] = column_mask << shuffles[i][j];
+    }
+  }
+  return result;
+}
+
+constexpr std::array<ColumnOrder, 6> column_orders = CreateColumnOrders();
+
+constexpr Board::BoardMask CreateLeftHalf() {
+  constexpr Board::BoardMask column_mask = Board::CreateColumnMask();
+  return column_mask | (column_mask << 1) | (column_mask << 2) |
+         (column_mask << 3);
+}
+
+// The columns worth searching in a position that is its own mirror image.
+// The moves on the right are just as good as their mirrors on the left.
+constexpr Board::BoardMask left_half = CreateLeftHalf();
+
+// The order in which the given thread tries the moves at the given level.
+// Thread zero always uses the best order. The Lazy SMP helpers vary their
+// order from level to level, as well as from each other, so they drift
+// apart.
+const ColumnOrder &GetColumnOrder(unsigned int thread, std::size_t level) {
+  if (thread == 0) {
+    return column_orders[0];
+  }
+  return column_orders[(thread + level) % column_orders.size()];
+}
+
+// A node is only split if it has at least this many empty squares.
+// Smaller subtrees are over before a helper could get started on them.
+constexpr std::size_t kMinSplitSquares = 16;
+
+// How many nodes a search visits between looks at the clock.
+constexpr std::size_t kClockInterval = 4096;
+
+// The size of Solve's table of bounds that depend on the horizon. It is
+// allocated for every call and cleared for every horizon, and its entries
+// are only good for one search, so it is kept small.
+constexpr std::size_t kHorizonMegabytes = 1;
+
+}  // namespace
+
+struct Board::SearchContext {
+  // A node whose remaining moves are shared out among the threads. The
+  // owner, the thread whose search reached the node, searches moves too,
+  // then waits for the helpers to finish theirs. Everything except
+  // cancelled is guarded by the pool's mutex.
+  struct SplitPoint {
+    SplitPoint(SplitPoint *parent, Position position, unsigned int whose_turn,
+               std::size_t level, Score best, Score cutoff, Score accum,
+               BoardMask best_move)
+        : parent(parent),
+          position(position),
+          whose_turn(whose_turn),
+          level(level),
+          best(best),
+          cutoff(cutoff),
+          accum(accum),
+          best_move(best_move) {}
+
+    // The split point the owner is itself helping with, if any.
+    // Cancelling it cancels this one too.
+    SplitPoint *parent;
+
+    Position position;
+    unsigned int whose_turn;
+    std::size_t level;  // Of the children of position, one below it.
+
+    BoardMask moves[kNumCols];
+    std::size_t num_moves = 0;
+    std::size_t next_move = 0;  // The next one to hand out.
+    std::size_t first_index = 0;  // Of moves[0] among the node's moves.
+    std::size_t workers = 0;    // Threads searching one of the moves.
+
+    // The same as in the owner's stack frame.
+    Score best, cutoff, accum;
+    BoardMask best_move;
+    int best_column = TranspositionTable::kNoColumn;
+    bool proven = true;
+
+    // Set when a move produces a cutoff. The remaining moves are not
+    // needed, and searches of the others are abandoned.
+    std::atomic<bool> cancelled = false;
+  };
+
+  // What the threads of a kSplit search share.
+  struct Pool {
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    // The split points that still have moves to hand out.
+    std::vector<SplitPoint *> open;
+
+    // The number of helpers waiting for work.
+    std::atomic<unsigned int> idle = 0;
+
+    // Set when the search is over, to release the helpers.
+    bool done = false;
+
+    // The first exception thrown by any thread.
+    std::exception_ptr error;
+  };
+
+  // What one thread learns about the moves as it searches, and what it
+  // counts. Each thread has its own, so none of it is locked.
+  struct Heuristics {
+    explicit Heuristics(MoveOrdering ordering) : ordering(ordering) {
+      for (auto &squares : killers) {
+        squares.fill(-1);
+      }
+    }
+
+    MoveOrdering ordering;
+
+    // The squares of the last two moves to cause a cutoff at each depth,
+    // the most recent first. Squares rather than columns, since the same
+    // column at the same depth is often a different move.
+    std::array<std::array<int, 2>, kMaxScoreDepth + 1> killers;
+
+    // For each player, and each square, the cutoffs caused by moves to
+    // the square other than the first move at a node, weighted by the
+    // square of the number of empty squares at the node, which favors the
+    // cutoffs that saved the most work.
+    std::array<std::array<std::uint64_t, kBoardSize>, 2> history = {};
+
+    SearchStats stats;
+  };
+
+  SearchContext(unsigned int thread, std::atomic<bool> &stop,
+                const SearchLimits &limits, Heuristics &heuristics,
+                Pool *pool = nullptr, SplitPoint *split = nullptr)
+      : thread(thread),
+        stop(stop),
+        limits(limits),
+        heuristics(heuristics),
+        pool(pool),
+        split(split) {}
+
+  // Whether the search has been made pointless by another thread.
+  bool Cancelled() const {
+    if (stop.load(std::memory_order_relaxed)) {
+      return true;
+    }
+    for (const SplitPoint *s = split; s != nullptr; s = s->parent) {
+      if (s->cancelled.load(std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Whether limits.deadline has passed. Only looks at the clock every
+  // kClockInterval calls, which is often enough.
+  bool PastDeadline() {
+    if (!limits.deadline.has_value() || --clock_countdown > 0) {
+      return false;
+    }
+    clock_countdown = kClockInterval;
+    return std::chrono::steady_clock::now() >= *limits.deadline;
+  }
+
+  bool CanSplit() const {
+    return pool != nullptr && pool->idle.load(std::memory_order_relaxed) > 0;
+  }
+
+  // Sorts the moves of a node at the given depth into the order to search
+  // them in, given that the table suggests table_column. The moves arrive
+  // in the thread's column order, which breaks ties.
+  void OrderMoves(const Position &position, unsigned int whose_turn,
+                  BoardMask my_triples, std::size_t depth, int table_column,
+                  BoardMask moves[], std::size_t num_moves) const;
+
+  // Learns from a cutoff caused by move, the move_index'th searched at a
+  // node at the given depth.
+  void RecordCutoff(const Position &position, std::size_t depth,
+                    unsigned int whose_turn, BoardMask move,
+                    std::size_t move_index);
+
+  // Searches the moves of split with whatever help is available.
+  void RunSplit(TranspositionTable &table, SplitPoint &split);
+
+  // The main loop of a helper thread.
+  void Help(TranspositionTable &table);
+
+  unsigned int thread;
+  std::atomic<bool> &stop;
+
+  const SearchLimits &limits;
+  Heuristics &heuristics;
+
+  Pool *pool;
+  SplitPoint *split;
+
+ private:
+  // Takes the next move from split and searches it. The lock must be
+  // held, and is released during the search.
+  void SearchMove(TranspositionTable &table, SplitPoint &split,
+                  std::unique_lock<std::mutex> &lock);
+
+  // Stops handing out the moves of split.
+  void Close(SplitPoint &split) { std::erase(pool->open, &split); }
+
+  std::size_t clock_countdown = kClockInterval;
+};
+
+void Board::SearchContext::OrderMoves(const Position &position,
+                                      unsigned int whose_turn,
+                                      BoardMask my_triples, std::size_t depth,
+                                      int table_column, BoardMask moves[],
+                                      std::size_t num_moves) const {
+  std::uint64_t scores[kNumCols];
+  switch (heuristics.ordering) {
+    case MoveOrdering::kStatic:
+      return;
+
+    case MoveOrdering::kHistory: {
+      constexpr std::uint64_t kTableScore = ~std::uint64_t{0};
+      const auto &killers = heuristics.killers[depth];
+      const auto &history = heuristics.history[whose_turn - 1];
+      for (std::size_t i = 0; i < num_moves; ++i) {
+        const int square = std::countr_zero(moves[i]);
+        if (static_cast<int>(square % kNumCols) == table_column) {
+          scores[i] = kTableScore;
+        } else if (square == killers[0]) {
+          scores[i] = kTableScore - 1;
+        } else if (square == killers[1]) {
+          scores[i] = kTableScore - 2;
+        } else {
+          scores[i] = history[square];
+        }
+      }
+      break;
+    }
+
+    case MoveOrdering::kThreats: {
+      const BoardMask mine =
+          whose_turn == 1 ? position.red_set : position.yellow_set;
+      const BoardMask empty = ~(position.red_set | position.yellow_set);
+      for (std::size_t i = 0; i < num_moves; ++i) {
+        // The squares that would complete a four-in-a-row, are still
+        // empty, and were not already threatened.
+        const BoardMask threats = FindNewTriples(mine | moves[i], moves[i]) &
+                                  empty & ~moves[i] & ~my_triples;
+        scores[i] = std::popcount(threats);
+      }
+      break;
+    }
+  }
+
+  // An insertion sort, which is stable, and quick for so few moves.
+  for (std::size_t i = 1; i < num_moves; ++i) {
+    const BoardMask move = moves[i];
+    const std::uint64_t score = scores[i];
+    std::size_t j = i;
+    for (; j > 0 && scores[j - 1] < score; --j) {
+      moves[j] = moves[j - 1];
+      scores[j] = scores[j - 1];
+    }
+    moves[j] = move;
+    scores[j] = score;
+  }
+}
+
+void Board::SearchContext::RecordCutoff(const Position &position,
+                                        std::size_t depth,
+                                        unsigned int whose_turn,
+                                        BoardMask move,
+                                        std::size_t move_index) {
+  if constexpr (kSearchStats) {
+    ++heuristics.stats.cutoffs;
+    ++heuristics.stats.cutoffs_by_depth[depth];
+    ++heuristics.stats.cutoffs_by_move[move_index];
+  }
+
+  const int square = std::countr_zero(move);
+  auto &killers = heuristics.killers[depth];
+  if (killers[0] != square) {
+    killers[1] = killers[0];
+    killers[0] = square;
+  }
+
+  // A cutoff by the first move only confirms the order already chosen.
+  if (move_index != 0) {
+    const std::uint64_t empty_squares =
+        kBoardSize - std::popcount(position.red_set | position.yellow_set);
+    heuristics.history[whose_turn - 1][square] +=
+        empty_squares * empty_squares;
+  }
+}
+
+void Board::SearchContext::RunSplit(TranspositionTable &table,
+                                    SplitPoint &split) {
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  pool->open.push_back(&split);
+  pool->changed.notify_all();
+  while (split.next_move < split.num_moves && !split.cancelled) {
+    SearchMove(table, split, lock);
+  }
+  // The helpers still hold pointers to split.
+  pool->changed.wait(lock, [&split]() { return split.workers == 0; });
+}
+
+void Board::SearchContext::Help(TranspositionTable &table) {
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  for (;;) {
+    ++pool->idle;
+    pool->changed.wait(lock,
+                       [this]() { return pool->done || !pool->open.empty(); });
+    --pool->idle;
+    if (pool->done) {
+      return;
+    }
+    // Prefer the split point nearest the root, which has the most work.
+    SearchMove(table, *pool->open.front(), lock);
+  }
+}
+
+void Board::SearchContext::SearchMove(TranspositionTable &table,
+                                      SplitPoint &split,
+                                      std::unique_lock<std::mutex> &lock) {
+  const std::size_t move_index = split.first_index + split.next_move;
+  const BoardMask move = split.moves[split.next_move++];
+  if (split.next_move == split.num_moves) {
+    Close(split);
+  }
+  ++split.workers;
+
+  // Swap cutoff and accum
+  const Score child_cutoff = -split.accum;
+  const Score child_accum = -split.cutoff;
+  lock.unlock();
+
+  Position child = split.position;
+  if (split.whose_turn == 1) {
+    child.red_set |= move;
+  } else {
+    child.yellow_set |= move;
+  }
+  SearchContext child_context(thread, stop, limits, heuristics, pool, &split);
+  std::optional<SearchResult> found;
+  std::exception_ptr error;
+  try {
+    found = Search(child, table, child_context, split.level, child_cutoff,
+                   child_accum);
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  lock.lock();
+  --split.workers;
+  pool->changed.notify_all();
+  if (error) {
+    // Give up on the whole search. BruteForce rethrows the exception.
+    if (!pool->error) {
+      pool->error = error;
+    }
+    stop = true;
+    return;
+  }
+  if (!found.has_value()) {
+    return;
+  }
+
+  // The same as report_result in Search.
+  if (!found->proven) {
+    split.proven = false;
+  }
+  const Score result = -found->value;
+  if (result > split.best) {
+    split.best = result;
+    split.best_move = move;
+    split.best_column = std::countr_zero(move) % kNumCols;
+    if (split.level > limits.exact_levels) {
+      if (result >= split.cutoff) {
+        split.cancelled = true;
+        Close(split);
+        RecordCutoff(split.position, split.level - 1, split.whose_turn, move,
+                     move_index);
+      } else if (result > split.accum) {
+        split.accum = result;
+      }
+    }
+  } else if (result == split.best) {
+    split.best_move |= move;
+  }
+}
+
+Board::BruteForceReturn4 Board::BruteForce(Board::Position position) {
+  TranspositionTable table;
+  return BruteForce(position, table);
+}
+
+Board::BruteForceReturn4 Board::BruteForce(Board::Position position,
+                                           TranspositionTable &table) {
+  return BruteForce(position, table, BruteForceOptions());
+}
+
+Board::BruteForceReturn4 Board::BruteForce(Board::Position position,
+                                           TranspositionTable &table,
+                                           const BruteForceOptions &options) {
+  if (options.book != nullptr) {
+    if (const auto found = options.book->Lookup(position); found.has_value()) {
+      return *found;
+    }
+  }
+  if (options.store != nullptr) {
+    if (const auto found = options.store->Lookup(position);
+        found.has_value()) {
+      return BruteForceReturn4(found->value.result, found->move);
+    }
+  }
+
+  if (options.new_search) {
+    table.NewSearch();
+  }
+  const SearchResult found = *SearchRoot(position, table, options, kInfScore,
+                                         kNilScore,
+                                         SearchLimits{.exact_levels = 2});
+  const Metric value = ToMetric(found.value);
+
+  // Search skips the right half of a symmetric position, so add the
+  // mirror images of the moves it found.
+  BoardMask move = found.best_move;
+  if (position.IsSymmetric()) {
+    move |= MirrorMask(move);
+  }
+  if (options.store != nullptr) {
+    options.store->Add(position, SolvedStore::Entry{value, move});
+  }
+  return BruteForceReturn4(value.result, move);
+}
+
+Board::SolveResult Board::Solve(
+    Board::Position position, std::chrono::steady_clock::time_point deadline) {
+  TranspositionTable table;
+  return Solve(position, table, deadline, BruteForceOptions());
+}
+
+Board::SolveResult Board::Solve(Board::Position position,
+                                TranspositionTable &table,
+                                std::chrono::steady_clock::time_point deadline,
+                                const BruteForceOptions &options) {
+  if (options.book != nullptr) {
+    if (const auto found = options.book->Lookup(position); found.has_value()) {
+      return SolveResult{found->result, found->move, /*proven=*/true, 0};
+    }
+  }
+  if (options.store != nullptr) {
+    if (const auto found = options.store->Lookup(position);
+        found.has_value()) {
+      return SolveResult{found->value.result, found->move, /*proven=*/true,
+                         0};
+    }
+  }
+
+  if (options.new_search) {
+    table.NewSearch();
+  }
+  const std::size_t empty_squares =
+      kBoardSize - std::popcount(position.red_set | position.yellow_set);
+
+  // Iterative deepening. Each search costs little next to the one after
+  // it, and leaves bounds in the table that speed that one up. Only the
+  // bounds that do not depend on the horizon go in the table, so it is
+  // still good for any other search; the rest go in a table of their own,
+  // which starts out empty each time. It has to be cleared, not just aged,
+  // since Probe returns old entries too. The first search is too quick to
+  // be worth timing.
+  std::optional<SolveResult> answer;
+  TranspositionTable horizon_table(kHorizonMegabytes);
+  SearchLimits limits{.exact_levels = 2, .horizon_table = &horizon_table};
+  for (limits.horizon = 1;; ++limits.horizon) {
+    if (limits.horizon > 1) {
+      horizon_table.Clear();
+    }
+    const auto found =
+        SearchRoot(position, table, options, kInfScore, kNilScore, limits);
+    if (!found.has_value()) {
+      break;  // Out of time.
+    }
+    BoardMask move = found->best_move;
+    if (position.IsSymmetric()) {
+      move |= MirrorMask(move);
+    }
+
+    // A position beyond the horizon scores as a draw, where its real
+    // value is a draw, or a win or loss that is further away still. So a
+    // win or loss within the horizon is the real value, and the same
+    // moves achieve it, but one beyond the horizon is only what the
+    // shortcuts for forced moves happened to see.
+    const bool proven = found->proven ||
+                        std::abs(found->value) >= WinScore(limits.horizon);
+    answer = SolveResult{ToMetric(found->value).result, move, proven,
+                         std::min(limits.horizon, empty_squares)};
+    if (proven) {
+      break;
+    }
+    limits.deadline = deadline;
+  }
+  return *answer;
+}
+
+BruteForceResult Board::ProveResult(Board::Position position,
+                                    TranspositionTable &table,
+                                    const BruteForceOptions &options) {
+  if (options.book != nullptr) {
+    if (const auto found = options.book->Lookup(position); found.has_value()) {
+      return found->result;
+    }
+  }
+  if (options.store != nullptr) {
+    if (const auto found = options.store->Lookup(position);
+        found.has_value()) {
+      return found->value.result;
+    }
+  }
+  return Prove(position, table, options, /*result_only=*/true).result;
+}
+
+Metric Board::ProveValue(Board::Position position, TranspositionTable &table,
+                         const BruteForceOptions &options) {
+  if (options.store != nullptr) {
+    if (const auto found = options.store->Lookup(position);
+        found.has_value()) {
+      return found->value;
+    }
+  }
+  return Prove(position, table, options, /*result_only=*/false);
+}
+
+Metric Board::Prove(Board::Position position, TranspositionTable &table,
+                    const BruteForceOptions &options, bool result_only) {
+  if (options.new_search) {
+    table.NewSearch();
+  }
+
+  // The value is known to lie in [lower, upper]. Each search asks whether
+  // it is at least some x, and the answer moves one end of the range.
+  // Every search fills the table with bounds, which the next one reuses.
+  Score lower = LossScore(0);
+  Score upper = WinScore(0);
+  while (lower < upper) {
+    Score x;
+    if (lower < 0 && upper >= 0) {
+      x = 0;  // Is it at least a draw?
+    } else if (lower <= 0 && upper > 0) {
+      x = 1;  // Is it at least a win?
+    } else if (result_only) {
+      break;
+    } else {
+      x = lower + (upper - lower + 1) / 2;
+    }
+    const Score value =
+        SearchRoot(position, table, options, x, x - 1, SearchLimits())->value;
+    if (value >= x) {
+      lower = value;
+    } else {
+      upper = value;
+    }
+  }
+  return ToMetric(lower);
+}
+
+std::optional<Board::SearchResult> Board::SearchRoot(
+    Board::Position position, TranspositionTable &table,
+    const BruteForceOptions &options, Score cutoff, Score accum,
+    const SearchLimits &limits) {
+  std::atomic<bool> stop = false;
+  std::vector<SearchContext::Heuristics> heuristics(
+      std::max(options.num_threads, 1u),
+      SearchContext::Heuristics(options.ordering));
+  std::chrono::steady_clock::time_point start;
+  if constexpr (kSearchStats) {
+    start = std::chrono::steady_clock::now();
+  }
+  const auto add_stats = [&options, &heuristics, start]() {
+    if (kSearchStats && options.stats != nullptr) {
+      for (const SearchContext::Heuristics &h : heuristics) {
+        *options.stats += h.stats;
+      }
+      options.stats->seconds += std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count();
+    }
+  };
+
+  if (options.num_threads <= 1) {
+    SearchContext context(0, stop, limits, heuristics[0]);
+    const auto found = Search(position, table, context, 0, cutoff, accum);
+    add_stats();
+    return found;
+  }
+
+  if (options.parallelism == Parallelism::kSplit) {
+    SearchContext::Pool pool;
+    const auto finish = [&pool]() {
+      {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.done = true;
+      }
+      pool.changed.notify_all();
+    };
+
+    std::optional<SearchResult> found;
+    {
+      // Declared after pool, so the helpers are joined before it goes
+      // away.
+      std::vector<std::jthread> helpers;
+      for (unsigned int thread = 1; thread < options.num_threads; ++thread) {
+        helpers.emplace_back(
+            [&table, &stop, &pool, &limits, &heuristics, thread]() {
+              SearchContext(thread, stop, limits, heuristics[thread], &pool)
+                  .Help(table);
+            });
+      }
+
+      SearchContext context(0, stop, limits, heuristics[0], &pool);
+      try {
+        found = Search(position, table, context, 0, cutoff, accum);
+      } catch (...) {
+        finish();
+        throw;
+      }
+      finish();
+    }  // Joins the helpers.
+    if (pool.error) {
+      std::rethrow_exception(pool.error);
+    }
+    add_stats();
+    return found;
+  }
+
+  // Lazy SMP: every thread searches the whole tree, and they cooperate
+  // only through the table. The first thread to finish has the answer.
+  // Each thread's answer is either exact or on the same side of the
+  // window, and the first exact levels are never pruned, so every thread
+  // finds the same result and the same set of best moves.
+  std::mutex mutex;  // Guards answer and error.
+  std::optional<SearchResult> answer;
+  std::exception_ptr error;
+  const auto work = [&](unsigned int thread) {
+    try {
+      SearchContext context(thread, stop, limits, heuristics[thread]);
+      const auto found = Search(position, table, context, 0, cutoff, accum);
+      if (found.has_value()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!answer.has_value()) {
+          answer = found;
+        }
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+    stop = true;
+  };
+
+  {
+    std::vector<std::jthread> helpers;
+    for (unsigned int thread = 1; thread < options.num_threads; ++thread) {
+      helpers.emplace_back(work, thread);
+    }
+    work(0);
+  }  // Joins the helpers.
+
+  if (answer.has_value() || !error) {
+    // Empty if every thread ran out of time.
+    add_stats();
+    return answer;
+  }
+  std::rethrow_exception(error);
+}
+
+std::optional<Board::SearchResult> Board::Search(Board::Position position,
+                                                 TranspositionTable &table,
+                                                 SearchContext &context,
+                                                 std::size_t level,
+                                                 Score cutoff, Score accum) {
+  // The returned result.
+  BoardMask best_move = 0;
+
+  struct StackFrame {
+    StackFrame(Position position, unsigned int whose_turn,
+               BoardMask legal_moves, BoardMask red_triples,
+               BoardMask yellow_triples, Score cutoff, Score accum)
+        : position(position),
+          whose_turn(whose_turn),
+          legal_moves(legal_moves),
+          best(kNilScore),  // Negative infinity.
+          red_triples(red_triples),
+          yellow_triples(yellow_triples),
+          cutoff(cutoff),
+          accum(accum),
+          initial_accum(accum) {}
+
+    // Input parameter
+    Position position;
+
+    // Redundant with position.
+    unsigned int whose_turn;  // 1 or 2
+
+    BoardMask legal_moves;
+
+    BoardMask moves[kNumCols];
+    std::size_t num_moves;
+    std::size_t current_move = 0;
+
+    Score best;
+
+    BoardMask red_triples, yellow_triples;
+
+    // Otherwise known as the alpha and beta in Alpha-beta pruning.
+    // Alpha-beta pruning significantly speeds up the search algorithm.
+    // We use a variation on the classic algorithm found at
+    // https://en.wikipedia.org/wiki/Alpha-beta_pruning#Pseudocode
+    // so that we can use the same code to evaluate the position of
+    // either player.
+    Score cutoff, accum;
+
+    // The value of accum when the frame was created. Together with cutoff,
+    // it tells us whether best is an exact value or just a bound.
+    Score initial_accum;
+
+    // The column of the move that produced best, for the table.
+    int best_column = TranspositionTable::kNoColumn;
+
+    // Cleared if best depends on a position beyond the horizon, in which
+    // case it is only good for this search, and stays out of the table.
+    bool proven = true;
+  };
+  std::vector<StackFrame> restack;  // The recursion stack.
+  restack.reserve(kBoardSize);
+
+  const auto stack_trace = [&restack]() {
+    std::cout << "**** Stack Trace ****\n";
+    for (std::size_t i = 0; i < restack.size(); ++i) {
+      const StackFrame &top = restack[i];
+      std::cout << std::format("Level {} {}/{}\n{}-------------\n", i,
+                               top.current_move, top.num_moves,
+                               top.position.image());
+    }
+  };
+
+  const auto stack_path = [&restack]() -> std::string {
+    std::ostringstream stream;
+    bool needs_dot = false;
+    for (const auto &frame : restack) {
+      if (needs_dot) {
+        stream << ".";
+      } else {
+        needs_dot = true;
+      }
+      stream << frame.current_move;
+    }
+    return stream.str();
+  };
+
+#define CACHING 1
+
+#if CACHING
+  // The table is keyed on the position alone, and holds bounds on its value
+  // rather than a single Score. The same position is often searched again
+  // with a different cutoff and accum, and the bounds found for one window
+  // are usually good enough to decide another.
+  using Bounds = TranspositionTable::Bounds;
+
+  // Bounds that depend on the horizon are only good until it moves, so
+  // they are kept apart from the rest.
+  const auto store = [&table, &context](const StackFrame &frame,
+                                        std::size_t frame_level,
+                                        const Bounds &bounds) {
+    if (frame.proven) {
+      const bool evicted =
+          table.Store(frame.position, frame_level, bounds, frame.best_column);
+      if constexpr (kSearchStats) {
+        ++context.heuristics.stats.table_stores;
+        context.heuristics.stats.table_evictions += evicted;
+      }
+    } else if (context.limits.horizon_table != nullptr) {
+      context.limits.horizon_table->Store(frame.position, frame_level, bounds,
+                                          frame.best_column);
+    }
+  };
+#endif
+
+  try {
+    // This variable is read at report_result.
+    Score result;
+
+    // These variables are read at the beginning of the loop.
+    // They should not be referenced elsewhere.
+    Board::Position new_pos = position;
+    unsigned int new_whose_turn = new_pos.WhoseTurn();
+    BoardMask new_legal_moves = position.LegalMoves();
+    BoardMask new_red_triples = FindTriples(position.red_set);
+    BoardMask new_yellow_triples = FindTriples(position.yellow_set);
+
+    Score new_cutoff = cutoff;
+    Score new_accum = accum;
+
+    // Used to report progress (during development).
+    std::size_t timer = 0;
+    static constexpr std::size_t kBlipTime = 100000000;
+    //                        max 18446744073709551615
+
+    for (;;) {
+      {
+        // Evaluate new_pos and new_whose_turn.
+        // If new_pos is warranted, a new stack frame is created,
+        // and the input values are used to create it.
+
+        Board::BoardMask my_triples;
+        Board::BoardMask his_triples;
+        switch (new_whose_turn) {
+          case 1:
+            my_triples = new_red_triples;
+            his_triples = new_yellow_triples;
+            break;
+          case 2:
+            my_triples = new_yellow_triples;
+            his_triples = new_red_triples;
+            break;
+          default:
+            throw std::runtime_error(
+                std::format("Bad value {}", new_whose_turn));
+        }
+
+        // See if I can win.
+        if (const BoardMask winning_move = my_triples & new_legal_moves;
+            winning_move != 0) {
+          if constexpr (kSearchStats) {
+            ++context.heuristics.stats.immediate_wins;
+          }
+          if (restack.empty()) {
+            return SearchResult{WinScore(level), winning_move};
+          }
+
+          // Reverse the polarity.
+          result = LossScore(level + restack.size());
+          goto report_result;
+        }
+
+        // See if I have a forced block or loss
+        const BoardMask move = his_triples & new_legal_moves;
+        if (move == 0 || std::popcount(move) == 1) {
+          // None or Block
+
+          // A move directly below one of his threats lets him win on top
+          // of it. Those moves are never searched, which is safe because
+          // every other move is better. If there are moves, but none
+          // of them is safe, I lose after any of them.
+          const BoardMask safe_moves =
+              new_legal_moves & ~(his_triples >> kNumCols);
+          if (move == 0 && safe_moves == 0 && new_legal_moves != 0) {
+            if constexpr (kSearchStats) {
+              ++context.heuristics.stats.forced_losses;
+            }
+            if (restack.empty()) {
+              return SearchResult{LossScore(level + 1), new_legal_moves};
+            }
+
+            // Reverse the polarity.
+            result = WinScore(level + restack.size() + 1);
+            goto report_result;
+          }
+
+          int table_column = TranspositionTable::kNoColumn;
+#if CACHING
+          {
+            // See if the table already decides new_pos. If so, proceed
+            // directly to report_result, which expects a reversed score.
+            // The root of the whole search is searched regardless, since
+            // its best moves are wanted too. If not, the table may still
+            // know which move to try first.
+            const bool decide = !restack.empty() || level > 0;
+            std::optional<Score> value;
+            bool proven = true;
+            if constexpr (kSearchStats) {
+              ++context.heuristics.stats.table_probes;
+            }
+            if (const auto found = table.Probe(new_pos, level + restack.size());
+                found.has_value()) {
+              table_column = found->column;
+              if (decide) {
+                value = found->bounds.Decide(new_cutoff, new_accum);
+              }
+            }
+            if (!value.has_value() && context.limits.horizon_table != nullptr) {
+              if (const auto found = context.limits.horizon_table->Probe(
+                      new_pos, level + restack.size());
+                  found.has_value()) {
+                if (table_column == TranspositionTable::kNoColumn) {
+                  table_column = found->column;
+                }
+                if (decide) {
+                  value = found->bounds.Decide(new_cutoff, new_accum);
+                  proven = false;
+                }
+              }
+            }
+            if (value.has_value()) {
+              if constexpr (kSearchStats) {
+                ++context.heuristics.stats.table_hits;
+              }
+              if (restack.empty()) {
+                return SearchResult{*value, 0, proven};
+              }
+              if (!proven) {
+                restack.back().proven = false;
+              }
+              result = -*value;
+              goto report_result;
+            }
+          }
+#endif
+          if (context.limits.horizon != 0 &&
+              level + restack.size() >= context.limits.horizon) {
+            // Too deep to search. Call it a draw, which is its own
+            // reverse, but one that proves nothing.
+            result = 0;
+            if (restack.empty()) {
+              return SearchResult{result, 0, /*proven=*/false};
+            }
+            restack.back().proven = false;
+            goto report_result;
+          }
+          restack.emplace_back(new_pos, new_whose_turn, new_legal_moves,
+                               new_red_triples, new_yellow_triples, new_cutoff,
+                               new_accum);
+          StackFrame &top = restack.back();
+          if constexpr (kSearchStats) {
+            SearchStats &stats = context.heuristics.stats;
+            ++stats.nodes;
+            stats.forced_blocks += move != 0;
+            stats.max_depth =
+                std::max(stats.max_depth, level + restack.size() - 1);
+          }
+
+          // Initialize top.num_moves and top.moves.
+          if (move == 0) {
+            // Extract the moves from safe_moves.
+            const BoardMask candidates = new_pos.IsSymmetric()
+                                             ? safe_moves & left_half
+                                             : safe_moves;
+            top.num_moves = 0;
+            for (BoardMask col :
+                 GetColumnOrder(context.thread, level + restack.size())) {
+              const BoardMask legal_move = candidates & col;
+              if (legal_move != 0) {
+                top.moves[top.num_moves++] = legal_move;
+              }
+            }
+            context.OrderMoves(new_pos, new_whose_turn, my_triples,
+                               level + restack.size() - 1, table_column,
+                               top.moves, top.num_moves);
+          } else {
+            // The only move is the forced block.
+            top.num_moves = 1;
+            top.moves[0] = move;
+          }
+          goto advance_top;
+        }
+
+        // Lose
+        if constexpr (kSearchStats) {
+          ++context.heuristics.stats.forced_losses;
+        }
+        if (restack.empty()) {
+          return SearchResult{LossScore(level), move};
+        }
+
+        // Reverse the polarity.
+        result = WinScore(level + restack.size());
+        // Fall into report_result
+      }
+
+    report_result: {
+      StackFrame &top = restack.back();
+      if (top.current_move == 0) {
+        throw std::runtime_error(std::format("current move equals zero"));
+      }
+      const BoardMask move = top.moves[top.current_move - 1];
+      if (result > top.best) {
+        top.best = result;
+        top.best_column = std::countr_zero(move) % kNumCols;
+        if (restack.size() == 1) {
+          best_move = move;
+        }
+
+        // Don't bother updating top.cutoff and top.accum if we are about
+        // to pop the stack.
+
+        // BruteForce cannot apply the Alpha/Beta optimization at
+        // Level 2. If it did, we would correctly determine who wins,
+        // but at Level 1 we could produce wrong winning moves.
+        if (level + restack.size() > context.limits.exact_levels &&
+            top.current_move < top.num_moves) {
+          if (result >= top.cutoff) {
+            context.RecordCutoff(top.position, level + restack.size() - 1,
+                                 top.whose_turn, move, top.current_move - 1);
+#if CACHING
+            store(top, level + restack.size() - 1,
+                  Bounds::FromSearch(result, top.cutoff, top.initial_accum));
+#endif
+            if (restack.size() == 1) {
+              return SearchResult{result, best_move, top.proven};
+            }
+
+            result = -result;
+            const bool proven = top.proven;
+            restack.pop_back();
+            if (!proven) {
+              restack.back().proven = false;
+            }
+            goto report_result;
+          }
+          if (result > top.accum) {
+            top.accum = result;
+          }
+        }
+      } else if (result == top.best && restack.size() == 1) {
+        best_move |= move;
+      }
+      // Fall into advance_top.
+    }
+
+    advance_top: {
+      if (restack.empty()) {
+        throw std::runtime_error("Stack empty");
+      }
+      StackFrame &top = restack.back();
+      if (context.Cancelled()) {
+        return std::nullopt;
+      }
+      if (context.PastDeadline()) {
+        // Stop the other threads too.
+        context.stop = true;
+        return std::nullopt;
+      }
+      if (top.current_move >= top.num_moves) {
+        if (top.best == kNilScore) {
+          // There were no legal moves.
+          top.best = 0;
+        }
+
+#if CACHING
+        store(top, level + restack.size() - 1,
+              Bounds::FromSearch(top.best, top.cutoff, top.initial_accum));
+#endif
+        if (restack.size() == 1) {
+          return SearchResult{top.best, best_move, top.proven};
+        }
+        result = -top.best;
+
+        const bool proven = top.proven;
+        restack.pop_back();
+        if (!proven) {
+          restack.back().proven = false;
+        }
+        goto report_result;
+      }
+
+      // Once the first move has been searched, other threads may help
+      // with the rest, if any are idle and there is enough work left to
+      // be worth handing out.
+      if (top.current_move > 0 && top.num_moves - top.current_move >= 2 &&
+          context.CanSplit() &&
+          kBoardSize - std::popcount(top.position.red_set |
+                                     top.position.yellow_set) >=
+              kMinSplitSquares) {
+        SearchContext::SplitPoint split(context.split, top.position,
+                                        top.whose_turn,
+                                        level + restack.size(), top.best,
+                                        top.cutoff, top.accum, best_move);
+        split.best_column = top.best_column;
+        split.first_index = top.current_move;
+        for (std::size_t i = top.current_move; i < top.num_moves; ++i) {
+          split.moves[split.num_moves++] = top.moves[i];
+        }
+        context.RunSplit(table, split);
+        if (context.Cancelled()) {
+          return std::nullopt;
+        }
+
+        // Carry on as if this thread had searched all the moves itself.
+        top.best = split.best;
+        top.best_column = split.best_column;
+        top.accum = split.accum;
+        if (!split.proven) {
+          top.proven = false;
+        }
+        if (restack.size() == 1) {
+          best_move = split.best_move;
+        }
+        top.current_move = top.num_moves;
+        goto advance_top;
+      }
+
+      // Get the next move.
+      const BoardMask move = top.moves[top.current_move++];
+
+      // Apply the next move to to top.position to create a new board
+      // position. Initialize new_pos, and new_whose_turn
+      // so that we can loop back to evaluate this new position.
+      new_pos = top.position;
+      if (top.whose_turn != new_pos.WhoseTurn()) {
+        throw std::runtime_error("turn out of whack\n");
+      }
+#if 0
+      std::cout << "Player " << top.whose_turn << " plays at "
+                << MaskImage(move) << "\nBoard:\n"
+                << new_pos.image();
+#endif
+      // Here is where the heavy lifting happens.
+      // Report progress so we can see how close we are to done.
+      if (++timer >= kBlipTime && context.thread == 0) {
+        std::clog << stack_path() << "\n";
+        timer = 0;
+      }
+
+      if (top.whose_turn == 1) {
+        new_pos.red_set |= move;
+        new_red_triples =
+            top.red_triples | FindNewTriples(new_pos.red_set, move);
+        new_yellow_triples = top.yellow_triples;
+      } else {
+        new_pos.yellow_set |= move;
+        new_yellow_triples =
+            top.yellow_triples | FindNewTriples(new_pos.yellow_set, move);
+        new_red_triples = top.red_triples;
+      }
+
+      // Update legal_moves to reflect the move just made.
+      static constexpr BoardMask kMoveLimit = OneMask(kBoardSize);
+      new_legal_moves = top.legal_moves & ~(move);
+      if (const BoardMask next_move = move << kNumCols;
+          next_move < kMoveLimit) {
+        new_legal_moves |= next_move;
+      }
+
+      new_whose_turn = 3 - top.whose_turn;
+      if (new_whose_turn != new_pos.WhoseTurn()) {
+        throw std::runtime_error("whose turn?");
+      }
+
+      // Swap cutoff and accum
+      new_cutoff = -top.accum;
+      new_accum = -top.cutoff;
+    }
+    }
+  } catch (const std::exception &e) {
+    std::cout << "Exception " << e.what() << "\n";
+    stack_trace();
+    throw;
+  } catch (...) {
+    std::cout << "Unknown exception\n";
+    stack_trace();
+    throw;
+  }
+}
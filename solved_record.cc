@@ -0,0 +1,67 @@
+#include "solved_record.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+
+// A record is the key, then the columns, then the depth, then the result.
+constexpr unsigned int kKeyShift = 15;
+constexpr unsigned int kColumnShift = 8;
+constexpr std::uint64_t kColumnMask = 0x7f;
+constexpr unsigned int kDepthShift = 2;
+constexpr std::uint64_t kDepthMask = 0x3f;
+constexpr std::uint64_t kResultMask = 3;
+
+}  // namespace
+
+std::uint64_t EncodeRecord(const Board::Position &position,
+                           const Metric &value, Board::BoardMask move) {
+  const std::uint64_t canonical = position.CanonicalKey();
+  Board::BoardMask columns = 0;
+  for (; move != 0; move &= move - 1) {
+    columns |= OneMask(std::countr_zero(move) % Board::kNumCols);
+  }
+  if (position.Key() != canonical) {
+    columns = MirrorMask(columns);
+  }
+  return (canonical << kKeyShift) | (columns << kColumnShift) |
+         (static_cast<std::uint64_t>(value.depth) << kDepthShift) |
+         static_cast<std::uint64_t>(value.result);
+}
+
+std::uint64_t RecordKey(std::uint64_t record) { return record >> kKeyShift; }
+
+Metric RecordValue(std::uint64_t record) {
+  return Metric(static_cast<BruteForceResult>(record & kResultMask),
+                (record >> kDepthShift) & kDepthMask);
+}
+
+Board::BoardMask RecordMove(std::uint64_t record,
+                            const Board::Position &position) {
+  Board::BoardMask columns = (record >> kColumnShift) & kColumnMask;
+  if (position.Key() != position.CanonicalKey()) {
+    columns = MirrorMask(columns);
+  }
+  const Board::BoardMask legal_moves = position.LegalMoves();
+  constexpr Board::BoardMask column_mask = Board::CreateColumnMask();
+  Board::BoardMask move = 0;
+  for (std::size_t col = 0; col < Board::kNumCols; ++col) {
+    if ((columns >> col) & 1) {
+      move |= legal_moves & (column_mask << col);
+    }
+  }
+  return move;
+}
+
+const std::uint64_t *FindRecord(const std::uint64_t *begin,
+                                const std::uint64_t *end, std::uint64_t key) {
+  const std::uint64_t *const found =
+      std::lower_bound(begin, end, key << kKeyShift);
+  if (found == end || RecordKey(*found) != key) {
+    return end;
+  }
+  return found;
+}
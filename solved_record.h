@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#include "board.h"
+
+// The 64-bit records in which OpeningBook and SolvedStore keep solved
+// positions. Each record holds the position's CanonicalKey in its top 49
+// bits, the columns of the best moves in the next 7, the depth of the
+// result in the next 6 (always zero in an OpeningBook), and the result in
+// the bottom 2. The columns are those of the canonical orientation, so a
+// position and its mirror image share a record.
+//
+// Records sort by key, so a sorted array of them can be searched in place.
+
+// Packs the value of position, and the moves that achieve it.
+std::uint64_t EncodeRecord(const Board::Position &position,
+                           const Metric &value, Board::BoardMask move);
+
+// The CanonicalKey of the record's position.
+std::uint64_t RecordKey(std::uint64_t record);
+
+Metric RecordValue(std::uint64_t record);
+
+// The moves in the record, as moves in position, which must be the
+// record's position or its mirror image.
+Board::BoardMask RecordMove(std::uint64_t record,
+                            const Board::Position &position);
+
+// Returns the record with the given key in the sorted records from begin
+// to end, or end if there is none.
+const std::uint64_t *FindRecord(const std::uint64_t *begin,
+                                const std::uint64_t *end, std::uint64_t key);
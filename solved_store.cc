@@ -0,0 +1,239 @@
+#include "solved_store.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char kMagic[8] = {'C', '4', 'S', 'T', 'O', 'R', 'E', '1'};
+
+struct RunHeader {
+  char magic[8];
+  std::uint64_t num_records;
+  std::uint64_t checksum;  // Of the records.
+};
+
+std::uint64_t Checksum(const std::uint64_t *records, std::size_t num_records) {
+  std::uint64_t result = num_records;
+  for (std::size_t i = 0; i < num_records; ++i) {
+    result = std::rotl((result ^ records[i]) * 0x9e3779b97f4a7c13, 29);
+  }
+  return result;
+}
+
+// Returns run, with enough zeros in front of it to start on a record
+// boundary in a file of file_size bytes.
+std::vector<char> Padded(const std::vector<char> &run,
+                         std::uint64_t file_size) {
+  std::vector<char> result(
+      (sizeof(std::uint64_t) - file_size % sizeof(std::uint64_t)) %
+      sizeof(std::uint64_t));
+  result.insert(result.end(), run.begin(), run.end());
+  return result;
+}
+
+#ifdef _WIN32
+
+// Appends run to the file at path, creating it if need be. Holds an
+// exclusive lock on the file while writing, so that the bytes are not
+// interleaved with those of another process. If the file does not end on
+// a record boundary, because a writer died part way through, pads it out
+// to one first, so that the run can be found.
+void AppendLocked(const std::string &path, const std::vector<char> &run) {
+  const HANDLE file = CreateFileA(
+      path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE,
+      nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error(std::format("{}: cannot open", path));
+  }
+  OVERLAPPED whole_file = {};
+  LARGE_INTEGER file_size;
+  if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD,
+                  &whole_file)) {
+    CloseHandle(file);
+    throw std::runtime_error(std::format("{}: cannot lock", path));
+  }
+  if (!GetFileSizeEx(file, &file_size)) {
+    UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &whole_file);
+    CloseHandle(file);
+    throw std::runtime_error(std::format("{}: unreadable", path));
+  }
+  const std::vector<char> bytes = Padded(run, file_size.QuadPart);
+  const char *next = bytes.data();
+  std::size_t size = bytes.size();
+  bool ok = true;
+  while (ok && size > 0) {
+    DWORD written;
+    const DWORD chunk =
+        static_cast<DWORD>(std::min<std::size_t>(size, 1 << 30));
+    ok = WriteFile(file, next, chunk, &written, nullptr);
+    next += written;
+    size -= written;
+  }
+  UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &whole_file);
+  CloseHandle(file);
+  if (!ok) {
+    throw std::runtime_error(std::format("{}: cannot write", path));
+  }
+}
+
+#else
+
+// Appends run to the file at path, creating it if need be. Holds an
+// exclusive lock on the file while writing, so that the bytes are not
+// interleaved with those of another process. If the file does not end on
+// a record boundary, because a writer died part way through, pads it out
+// to one first, so that the run can be found.
+void AppendLocked(const std::string &path, const std::vector<char> &run) {
+  const int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("{}: cannot open", path));
+  }
+  struct stat status;
+  if (flock(fd, LOCK_EX) != 0 || fstat(fd, &status) != 0) {
+    close(fd);
+    throw std::runtime_error(std::format("{}: cannot lock", path));
+  }
+  const std::vector<char> bytes = Padded(run, status.st_size);
+  const char *next = bytes.data();
+  std::size_t size = bytes.size();
+  bool ok = true;
+  while (ok && size > 0) {
+    const ssize_t written = write(fd, next, size);
+    ok = written > 0;
+    if (ok) {
+      next += written;
+      size -= written;
+    }
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+  if (!ok) {
+    throw std::runtime_error(std::format("{}: cannot write", path));
+  }
+}
+
+#endif
+
+}  // namespace
+
+SolvedStore::SolvedStore(const std::string &path) : path_(path) {
+  std::error_code error;
+  if (std::filesystem::file_size(path, error) == 0 || error) {
+    return;  // Nothing stored yet.
+  }
+  file_ = std::make_unique<MappedFile>(path);
+  const char *const data = static_cast<const char *>(file_->data());
+  const std::size_t size = file_->size();
+  if (size < sizeof(kMagic) ||
+      std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error(std::format("{}: not a store", path));
+  }
+
+  std::size_t offset = 0;
+  while (offset + sizeof(RunHeader) <= size) {
+    RunHeader header;
+    std::memcpy(&header, data + offset, sizeof(header));
+    const std::size_t room =
+        (size - offset - sizeof(header)) / sizeof(std::uint64_t);
+    const std::uint64_t *const records =
+        reinterpret_cast<const std::uint64_t *>(data + offset +
+                                                sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+        header.num_records <= room &&
+        Checksum(records, header.num_records) == header.checksum) {
+      runs_.push_back(Run{records, header.num_records});
+      offset += sizeof(header) + header.num_records * sizeof(std::uint64_t);
+    } else {
+      // Not a whole run. Look for the next one.
+      offset += sizeof(std::uint64_t);
+    }
+  }
+}
+
+SolvedStore::~SolvedStore() {
+  try {
+    Flush();
+  } catch (...) {
+  }
+}
+
+std::optional<SolvedStore::Entry> SolvedStore::Lookup(
+    const Board::Position &position) const {
+  const std::uint64_t canonical = position.CanonicalKey();
+  for (const Run &run : runs_) {
+    const std::uint64_t *const end = run.records + run.num_records;
+    if (const std::uint64_t *const found =
+            FindRecord(run.records, end, canonical);
+        found != end) {
+      return Entry{RecordValue(*found), RecordMove(*found, position)};
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  const std::uint64_t *const end = added_.data() + added_.size();
+  const std::uint64_t *const found =
+      FindRecord(added_.data(), end, canonical);
+  if (found == end) {
+    return std::nullopt;
+  }
+  return Entry{RecordValue(*found), RecordMove(*found, position)};
+}
+
+void SolvedStore::Add(const Board::Position &position, const Entry &entry) {
+  const std::uint64_t canonical = position.CanonicalKey();
+  const std::uint64_t record = EncodeRecord(position, entry.value, entry.move);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto where = std::lower_bound(
+      added_.begin(), added_.end(), canonical,
+      [](std::uint64_t record, std::uint64_t key) {
+        return RecordKey(record) < key;
+      });
+  if (where != added_.end() && RecordKey(*where) == canonical) {
+    return;  // Already added.
+  }
+  added_.insert(where, record);
+  pending_.push_back(record);
+}
+
+void SolvedStore::Flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_.empty()) {
+    return;
+  }
+  std::sort(pending_.begin(), pending_.end());
+
+  RunHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.num_records = pending_.size();
+  header.checksum = Checksum(pending_.data(), pending_.size());
+  std::vector<char> run(sizeof(header) +
+                          pending_.size() * sizeof(std::uint64_t));
+  std::memcpy(run.data(), &header, sizeof(header));
+  std::memcpy(run.data() + sizeof(header), pending_.data(),
+              pending_.size() * sizeof(std::uint64_t));
+  AppendLocked(path_, run);
+  pending_.clear();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "mapped_file.h"
+#include "solved_record.h"
+
+// A file of solved positions that grows as positions are solved, so that
+// work done by one run of the solver is not repeated by the next. Unlike
+// the OpeningBook, which is built once ahead of time, any number of
+// solver processes may add to the same store at once.
+//
+// The file is only ever appended to. It is a sequence of runs, each a
+// header followed by a sorted array of records (see solved_record.h)
+// that, unlike those of an OpeningBook, hold the depth of the result. A process
+// maps the file when it opens the store and binary-searches each run in
+// place. Positions it solves are kept in memory until Flush, which
+// appends them as a new run while holding an exclusive lock on the file,
+// so runs written by different processes never interleave. Each run has
+// a checksum, and a run that is incomplete, because it was still being
+// written when the file was mapped or its writer died, is skipped.
+//
+// A store only sees the runs that were in the file when it was opened,
+// plus the positions added to it since. Every run is another binary
+// search, so it pays to Flush in large batches.
+class SolvedStore {
+ public:
+  // Opens the store at path. The file is created on the first Flush if
+  // it does not exist. Throws std::runtime_error if the file exists but
+  // is not a store.
+  explicit SolvedStore(const std::string &path);
+
+  // Flushes, but ignores any errors.
+  ~SolvedStore();
+
+  SolvedStore(const SolvedStore &) = delete;
+  SolvedStore &operator=(const SolvedStore &) = delete;
+
+  struct Entry {
+    // The exact value, with its depth measured from the position.
+    Metric value;
+
+    // All the best moves, as in BruteForce.
+    Board::BoardMask move;
+  };
+
+  // Returns what is known about position, if anything. Safe to call from
+  // several threads at once, and at the same time as Add.
+  std::optional<Entry> Lookup(const Board::Position &position) const;
+
+  // Remembers the solution of position, to be written by the next Flush.
+  void Add(const Board::Position &position, const Entry &entry);
+
+  // Appends the positions added since the last Flush to the file. Throws
+  // std::runtime_error if the file cannot be written.
+  void Flush();
+
+  // The number of runs that were found in the file when it was opened.
+  std::size_t num_runs() const { return runs_.size(); }
+
+ private:
+  struct Run {
+    const std::uint64_t *records;
+    std::size_t num_records;
+  };
+
+  std::string path_;
+  std::unique_ptr<MappedFile> file_;  // Null if there was no file.
+  std::vector<Run> runs_;
+
+  // All the records added since the file was mapped, sorted, and those
+  // not yet flushed, in the order they were added.
+  mutable std::mutex mutex_;
+  std::vector<std::uint64_t> added_;
+  std::vector<std::uint64_t> pending_;
+};
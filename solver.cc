@@ -0,0 +1,233 @@
+#include "solver.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+#include "transposition_table.h"
+
+namespace {
+
+// Whether the game can go from position a to position b.
+bool LeadsTo(const Board::Position &a, const Board::Position &b) {
+  return (a.red_set & ~b.red_set) == 0 && (a.yellow_set & ~b.yellow_set) == 0;
+}
+
+int NumPieces(const Board::Position &position) {
+  return std::popcount(position.red_set | position.yellow_set);
+}
+
+// A queue of the games in a batch, for one of ParallelSolveBatch's
+// threads. The thread takes games from the front; others steal from the
+// back.
+struct GameQueue {
+  std::mutex mutex;
+  std::deque<const std::vector<std::size_t> *> games;
+};
+
+// Returns the next game for thread to solve, if any are left.
+const std::vector<std::size_t> *TakeGame(std::vector<GameQueue> &queues,
+                                         std::size_t thread) {
+  for (std::size_t i = 0; i < queues.size(); ++i) {
+    GameQueue &queue = queues[(thread + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.games.empty()) {
+      continue;
+    }
+    const std::vector<std::size_t> *game;
+    if (i == 0) {
+      game = queue.games.front();
+      queue.games.pop_front();
+    } else {
+      game = queue.games.back();
+      queue.games.pop_back();
+    }
+    return game;
+  }
+  return nullptr;
+}
+
+using Seconds = std::chrono::duration<double>;
+
+}  // namespace
+
+double Solver::BatchStats::NodesPerSecond() const {
+  return seconds == 0 ? 0 : search.nodes / seconds;
+}
+
+double Solver::BatchStats::HitRate() const {
+  return search.table_probes == 0
+             ? 0
+             : static_cast<double>(search.table_hits) / search.table_probes;
+}
+
+double Solver::BatchStats::Percentile(double fraction) const {
+  if (latencies.empty()) {
+    return 0;
+  }
+  // The nearest rank.
+  std::vector<double> sorted = latencies;
+  std::sort(sorted.begin(), sorted.end());
+  const double rank = std::ceil(fraction * sorted.size());
+  const std::size_t index =
+      rank < 1 ? 0
+               : std::min(sorted.size(), static_cast<std::size_t>(rank)) - 1;
+  return sorted[index];
+}
+
+Solver::Solver(std::size_t megabytes, const Board::BruteForceOptions &options)
+    : megabytes_(megabytes), table_(megabytes), options_(options) {}
+
+Board::BruteForceReturn4 Solver::Solve(const Board::Position &position) {
+  return Board::BruteForce(position, table_, options_);
+}
+
+std::vector<Board::BruteForceReturn4> Solver::SolveBatch(
+    std::span<const Board::Position> positions) {
+  std::vector<Board::BruteForceReturn4> result(positions.size());
+  for (const std::size_t i : BatchOrder(positions)) {
+    result[i] = Solve(positions[i]);
+  }
+  return result;
+}
+
+std::vector<std::size_t> Solver::BatchOrder(
+    std::span<const Board::Position> positions) {
+  std::vector<std::size_t> result;
+  result.reserve(positions.size());
+  for (const std::vector<std::size_t> &game : BatchGames(positions)) {
+    result.insert(result.end(), game.begin(), game.end());
+  }
+  return result;
+}
+
+std::vector<std::vector<std::size_t>> Solver::BatchGames(
+    std::span<const Board::Position> positions) {
+  // The positions with the most pieces first.
+  std::vector<std::size_t> by_size(positions.size());
+  std::iota(by_size.begin(), by_size.end(), 0);
+  std::stable_sort(by_size.begin(), by_size.end(),
+                   [positions](std::size_t lhs, std::size_t rhs) {
+                     return NumPieces(positions[lhs]) >
+                            NumPieces(positions[rhs]);
+                   });
+
+  std::vector<Board::Position> mirrors;
+  mirrors.reserve(positions.size());
+  for (const Board::Position &position : positions) {
+    mirrors.push_back(position.Mirror());
+  }
+
+  std::vector<std::vector<std::size_t>> result;
+  std::vector<bool> done(positions.size(), false);
+  for (const std::size_t start : by_size) {
+    if (done[start]) {
+      continue;
+    }
+    // Follow the game back from the largest position left.
+    std::vector<std::size_t> &game = result.emplace_back();
+    std::size_t current = start;
+    for (;;) {
+      done[current] = true;
+      game.push_back(current);
+      const auto next = std::find_if(
+          by_size.begin(), by_size.end(),
+          [&done, &mirrors, current, positions](std::size_t i) {
+            return !done[i] && (LeadsTo(positions[i], positions[current]) ||
+                                LeadsTo(mirrors[i], positions[current]));
+          });
+      if (next == by_size.end()) {
+        break;
+      }
+      current = *next;
+    }
+  }
+  return result;
+}
+
+std::vector<Board::BruteForceReturn4> Solver::ParallelSolveBatch(
+    std::span<const Board::Position> positions,
+    const BatchOptions &batch_options, BatchStats *stats) {
+  const auto start = std::chrono::steady_clock::now();
+  unsigned int num_threads = batch_options.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  const std::vector<std::vector<std::size_t>> games = BatchGames(positions);
+  std::vector<GameQueue> queues(num_threads);
+  for (std::size_t i = 0; i < games.size(); ++i) {
+    queues[i % num_threads].games.push_back(&games[i]);
+  }
+
+  std::vector<Board::BruteForceReturn4> result(positions.size());
+  std::vector<double> latencies(positions.size());
+  std::vector<Board::SearchStats> thread_stats(num_threads);
+  std::vector<std::exception_ptr> errors(num_threads);
+  if (batch_options.table_policy == TablePolicy::kShared) {
+    // Once for the batch; the searches themselves leave the age alone.
+    table_.NewSearch();
+  }
+  const auto work = [&](std::size_t thread) {
+    try {
+      std::optional<TranspositionTable> private_table;
+      TranspositionTable *table = &table_;
+      if (batch_options.table_policy == TablePolicy::kPrivate) {
+        table = &private_table.emplace(megabytes_);
+      }
+      Board::BruteForceOptions options = options_;
+      options.stats = &thread_stats[thread];
+      if (batch_options.table_policy == TablePolicy::kShared) {
+        options.new_search = false;
+      }
+      while (const std::vector<std::size_t> *game = TakeGame(queues, thread)) {
+        for (const std::size_t i : *game) {
+          const auto solve_start = std::chrono::steady_clock::now();
+          result[i] = Board::BruteForce(positions[i], *table, options);
+          latencies[i] =
+              Seconds(std::chrono::steady_clock::now() - solve_start).count();
+        }
+      }
+    } catch (...) {
+      errors[thread] = std::current_exception();
+    }
+  };
+  {
+    std::vector<std::jthread> threads;
+    for (unsigned int thread = 1; thread < num_threads; ++thread) {
+      threads.emplace_back(work, thread);
+    }
+    work(0);
+  }  // Joins the threads.
+  for (const std::exception_ptr &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  Board::SearchStats total;
+  for (const Board::SearchStats &search : thread_stats) {
+    total += search;
+  }
+  if (options_.stats != nullptr) {
+    *options_.stats += total;
+  }
+  if (stats != nullptr) {
+    stats->search = total;
+    stats->seconds = Seconds(std::chrono::steady_clock::now() - start).count();
+    stats->latencies = std::move(latencies);
+  }
+  return result;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "board.h"
+#include "transposition_table.h"
+
+// Solves many positions with one transposition table, which lasts as long
+// as the Solver does, so each solution can reuse what was learned solving
+// the ones before it. Board::BruteForce(position) starts from an empty
+// table every time.
+class Solver {
+ public:
+  explicit Solver(
+      std::size_t megabytes = TranspositionTable::kDefaultMegabytes,
+      const Board::BruteForceOptions &options = Board::BruteForceOptions());
+
+  Solver(const Solver &) = delete;
+  Solver &operator=(const Solver &) = delete;
+
+  // The same as Board::BruteForce.
+  Board::BruteForceReturn4 Solve(const Board::Position &position);
+
+  // Solves all the positions, returning the solutions in the same order.
+  // The positions are solved in the order given by BatchOrder.
+  std::vector<Board::BruteForceReturn4> SolveBatch(
+      std::span<const Board::Position> positions);
+
+  // The order in which SolveBatch solves positions, as indices into
+  // positions. Each position is followed by the largest position left
+  // that leads to it (or to its mirror image), so the positions from one
+  // game run together, from the end of the game back to the start, and
+  // each one finds the positions below it already in the table. Takes
+  // time quadratic in the size of the batch, which is nothing next to
+  // the solving.
+  static std::vector<std::size_t> BatchOrder(
+      std::span<const Board::Position> positions);
+
+  // How ParallelSolveBatch gives its threads transposition tables.
+  enum class TablePolicy {
+    // All the threads use this Solver's table, and each one benefits from
+    // what the others have learned. The table is aged once for the whole
+    // batch, not once per position, so that one thread's search does not
+    // age the entries another is still using. Within the batch, entries
+    // are replaced by how much work they hold, whoever stored them.
+    kShared,
+
+    // Each thread has a table of its own, as large as this Solver's, for
+    // the length of the batch. The threads never compete for entries, but
+    // learn nothing from each other, and the tables are thrown away.
+    kPrivate,
+  };
+
+  struct BatchOptions {
+    // The number of positions solved at once. Zero means one per core.
+    unsigned int num_threads = 0;
+
+    TablePolicy table_policy = TablePolicy::kShared;
+  };
+
+  // What happened during a ParallelSolveBatch.
+  struct BatchStats {
+    // The counts for all the searches together.
+    Board::SearchStats search;
+
+    // The time taken by the whole batch, in seconds.
+    double seconds = 0;
+
+    // The time taken by each position, in seconds, in the order of the
+    // batch.
+    std::vector<double> latencies;
+
+    double NodesPerSecond() const;
+
+    // The fraction of the table probes that decided the position.
+    double HitRate() const;
+
+    // The latency that the given fraction of the positions were solved
+    // within, such as 0.5 for the median or 0.99 for the 99th percentile.
+    double Percentile(double fraction) const;
+  };
+
+  // The same as SolveBatch, but solves several positions at once, each
+  // on a thread of its own (on top of any threads the BruteForceOptions
+  // ask for within each position). The games found by BatchOrder are
+  // dealt out to queues, one per thread. A thread solves the games in
+  // its own queue, front first, and when that runs dry, takes games from
+  // the backs of the others, so that one long solve does not hold up the
+  // rest. If stats is not null, fills it in.
+  std::vector<Board::BruteForceReturn4> ParallelSolveBatch(
+      std::span<const Board::Position> positions,
+      const BatchOptions &batch_options, BatchStats *stats = nullptr);
+
+  TranspositionTable &table() { return table_; }
+  const Board::BruteForceOptions &options() const { return options_; }
+
+ private:
+  // BatchOrder, divided into the runs that come from one game.
+  static std::vector<std::vector<std::size_t>> BatchGames(
+      std::span<const Board::Position> positions);
+
+  std::size_t megabytes_;
+  TranspositionTable table_;
+  Board::BruteForceOptions options_;
+};
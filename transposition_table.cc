@@ -0,0 +1,233 @@
+#include "transposition_table.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+// An entry holds, from the low bits up, the lower and upper bounds, the
+// work (6 bits), the age (4 bits), the best column (3 bits), a bit that is
+// set in every entry so that an empty entry never matches, and the high
+// 32 bits of the hash.
+//
+// A Score is packed into a byte, offset so that kNilScore is zero.
+constexpr unsigned int kScoreBits = 8;
+constexpr std::uint64_t kScoreMask = (UINT64_C(1) << kScoreBits) - 1;
+constexpr unsigned int kWorkShift = 2 * kScoreBits;
+constexpr unsigned int kAgeShift = kWorkShift + 6;
+constexpr std::uint64_t kAgeMask = 0xf;
+constexpr unsigned int kColumnShift = kAgeShift + 4;
+constexpr std::uint64_t kColumnMask = 7;
+constexpr std::uint64_t kValidBit = UINT64_C(1) << 31;
+constexpr unsigned int kFragmentShift = 32;
+
+static_assert(kInfScore - kNilScore <= kScoreMask);
+static_assert(kColumnShift + 3 <= 31);
+
+bool SameFragment(std::uint64_t entry, std::uint64_t hash) {
+  return entry != 0 && (entry >> kFragmentShift) == (hash >> kFragmentShift);
+}
+
+std::uint64_t PackScore(Score score) {
+  return static_cast<std::uint64_t>(score - kNilScore);
+}
+
+Score UnpackScore(std::uint64_t bits) {
+  return static_cast<Score>(bits & kScoreMask) + kNilScore;
+}
+
+// Converts between depths measured from the root of a search and depths
+// measured from a position at the given level of that search. A win
+// that far down is worth less to the root, and a loss more.
+Score Relative(Score score, std::size_t level) {
+  const Score shift = static_cast<Score>(level);
+  if (score > 0 && score < kInfScore) {
+    if (score + shift > kWinScore) {
+      throw std::runtime_error("Score above its position");
+    }
+    return score + shift;
+  }
+  if (score < 0 && score > kNilScore) {
+    if (score - shift < -kWinScore) {
+      throw std::runtime_error("Score above its position");
+    }
+    return score - shift;
+  }
+  return score;
+}
+
+Score Absolute(Score score, std::size_t level) {
+  const Score shift = static_cast<Score>(level);
+  if (score > 0 && score < kInfScore) {
+    return score - shift;
+  }
+  if (score < 0 && score > kNilScore) {
+    return score + shift;
+  }
+  return score;
+}
+
+}  // namespace
+
+TranspositionTable::Bounds TranspositionTable::Bounds::FromSearch(
+    Score value, Score cutoff, Score accum) {
+  Bounds result;
+  if (value > accum) {
+    result.lower = value;
+  }
+  if (value < cutoff) {
+    result.upper = value;
+  }
+  return result;
+}
+
+std::optional<Score> TranspositionTable::Bounds::Decide(Score cutoff,
+                                                        Score accum) const {
+  if (exact()) {
+    return lower;
+  }
+  if (lower != kNilScore && lower >= cutoff) {
+    return lower;
+  }
+  if (upper != kInfScore && upper <= accum) {
+    return upper;
+  }
+  return std::nullopt;
+}
+
+TranspositionTable::TranspositionTable(std::size_t megabytes) {
+  // Round down to a power of two, but always have at least one bucket.
+  const std::size_t bytes = megabytes << 20;
+  num_buckets_ =
+      std::max<std::size_t>(std::bit_floor(bytes / sizeof(Bucket)), 1);
+  buckets_ = std::make_unique<Bucket[]>(num_buckets_);
+}
+
+void TranspositionTable::Clear() {
+  for (std::size_t i = 0; i < num_buckets_; ++i) {
+    for (std::atomic<std::uint64_t> &entry : buckets_[i].entries) {
+      entry.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+TranspositionTable::Slot TranspositionTable::Locate(
+    const Board::Position &position) {
+  // A position and its mirror image share a key, the smaller of their
+  // own keys, and so share an entry.
+  const std::uint64_t key = position.Key();
+  const std::uint64_t mirror = MirrorMask(key);
+  const bool flipped = mirror < key;
+
+  // Spread the key over all 64 bits. Every step can be undone, so
+  // different keys always have different hashes.
+  std::uint64_t hash = flipped ? mirror : key;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccd;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53;
+  hash ^= hash >> 33;
+  return Slot{hash, flipped};
+}
+
+std::uint64_t TranspositionTable::Pack(std::uint64_t hash,
+                                       const Bounds &bounds, unsigned int work,
+                                       std::uint8_t age, unsigned int column) {
+  return PackScore(bounds.lower) | (PackScore(bounds.upper) << kScoreBits) |
+         (static_cast<std::uint64_t>(work) << kWorkShift) |
+         ((age & kAgeMask) << kAgeShift) |
+         (static_cast<std::uint64_t>(column) << kColumnShift) | kValidBit |
+         (hash >> kFragmentShift << kFragmentShift);
+}
+
+TranspositionTable::Bounds TranspositionTable::Unpack(std::uint64_t entry) {
+  return Bounds(UnpackScore(entry), UnpackScore(entry >> kScoreBits));
+}
+
+std::optional<TranspositionTable::Bounds> TranspositionTable::Lookup(
+    const Board::Position &position, std::size_t level) const {
+  if (const auto found = Probe(position, level); found.has_value()) {
+    return found->bounds;
+  }
+  return std::nullopt;
+}
+
+std::optional<TranspositionTable::Entry> TranspositionTable::Probe(
+    const Board::Position &position, std::size_t level) const {
+  const Slot slot = Locate(position);
+  for (const std::atomic<std::uint64_t> &entry :
+       BucketFor(slot.hash).entries) {
+    const std::uint64_t data = entry.load(std::memory_order_relaxed);
+    if (SameFragment(data, slot.hash)) {
+      const Bounds bounds = Unpack(data);
+      int column = static_cast<int>((data >> kColumnShift) & kColumnMask) - 1;
+      if (slot.flipped && column != kNoColumn) {
+        column = Board::kNumCols - 1 - column;
+      }
+      return Entry{Bounds(Absolute(bounds.lower, level),
+                          Absolute(bounds.upper, level)),
+                   column};
+    }
+  }
+  return std::nullopt;
+}
+
+bool TranspositionTable::Store(const Board::Position &position,
+                               std::size_t level, Bounds bounds, int column) {
+  bounds.lower = Relative(bounds.lower, level);
+  bounds.upper = Relative(bounds.upper, level);
+
+  const Slot slot = Locate(position);
+  const std::uint64_t hash = slot.hash;
+  if (slot.flipped && column != kNoColumn) {
+    column = Board::kNumCols - 1 - column;
+  }
+  const std::uint8_t age = age_.load(std::memory_order_relaxed);
+  std::atomic<std::uint64_t> *victim = nullptr;
+  int victim_value = std::numeric_limits<int>::max();
+  bool same_position = false;
+  for (std::atomic<std::uint64_t> &entry : BucketFor(hash).entries) {
+    const std::uint64_t data = entry.load(std::memory_order_relaxed);
+    if (SameFragment(data, hash)) {
+      // Keep the tighter of the old and new bounds.
+      const Bounds fresh = bounds;
+      const Bounds old = Unpack(data);
+      bounds.lower = std::max(bounds.lower, old.lower);
+      bounds.upper = std::min(bounds.upper, old.upper);
+      if (bounds.lower > bounds.upper) {
+        // Only possible if two positions share a bucket and a fragment.
+        // Trust the caller.
+        bounds = fresh;
+      }
+      if (column == kNoColumn) {
+        column = static_cast<int>((data >> kColumnShift) & kColumnMask) - 1;
+      }
+      victim = &entry;
+      same_position = true;
+      break;
+    }
+
+    // An entry from the current search is worth more than any entry from
+    // an earlier one. Otherwise, more empty squares means more work.
+    const bool current = ((data >> kAgeShift) & kAgeMask) == (age & kAgeMask);
+    const int value =
+        data == 0 ? -1
+                  : static_cast<int>((data >> kWorkShift) & 63) +
+                        (current ? 64 : 0);
+    if (value < victim_value) {
+      victim = &entry;
+      victim_value = value;
+    }
+  }
+
+  const unsigned int work =
+      Board::kBoardSize - std::popcount(position.red_set | position.yellow_set);
+  victim->store(Pack(hash, bounds, work, age, column + 1),
+                std::memory_order_relaxed);
+  return victim_value >= 0 && !same_position;
+}
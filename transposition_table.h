@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#include "board.h"
+
+// A fixed-size hash table of bounds on the values of positions, used by
+// Board::BruteForce to avoid searching the same position twice. Each entry
+// also remembers the best move found for its position, which is the first
+// one to try when the position is searched again.
+//
+// All the memory is allocated when the table is constructed. The table
+// is a power-of-two array of 64-byte buckets, each holding eight 8-byte
+// entries, so a probe touches a single cache line. When a bucket is full,
+// a new entry replaces the one that is least valuable: entries left over
+// from previous searches go first, then those with the fewest empty
+// squares (the least work to recompute).
+//
+// Positions are identified by Position::CanonicalKey, scrambled by a
+// one-to-one hash. The low bits of the hash choose the bucket, and each
+// entry keeps the high 32 bits to tell the positions in a bucket apart.
+// Two positions are only confused if their hashes agree in all of those
+// bits.
+//
+// Each entry is a single 64-bit word, read and written atomically, so the
+// table can be shared by threads without locks.
+class TranspositionTable {
+ public:
+  static constexpr std::size_t kDefaultMegabytes = 16;
+
+  // What is known about the value of a position, from the point of view
+  // of the player to move.
+  struct Bounds {
+    // Nothing is known; the value could be anything.
+    Bounds() : lower(kNilScore), upper(kInfScore) {}
+    Bounds(Score lower, Score upper) : lower(lower), upper(upper) {}
+    bool operator==(const Bounds &) const = default;
+
+    // Interprets value, the result of an alpha-beta search with the given
+    // window. The search only promises an exact value if it lies strictly
+    // inside the window. A value at or below accum is an upper bound, and
+    // a value at or above cutoff is a lower bound.
+    static Bounds FromSearch(Score value, Score cutoff, Score accum);
+
+    // Returns a value if the bounds decide the position for the given
+    // window. The value may itself be a bound, but if so it is on the far
+    // side of the window, which is all that alpha-beta pruning needs.
+    std::optional<Score> Decide(Score cutoff, Score accum) const;
+
+    bool exact() const { return lower == upper; }
+
+    Score lower;  // The value is at least this good.
+    Score upper;  // The value is at most this good.
+  };
+
+  explicit TranspositionTable(std::size_t megabytes = kDefaultMegabytes);
+
+  TranspositionTable(const TranspositionTable &) = delete;
+  TranspositionTable &operator=(const TranspositionTable &) = delete;
+
+  // The column of a move, if no move is known.
+  static constexpr int kNoColumn = -1;
+
+  struct Entry {
+    Bounds bounds;
+
+    // The column of the move that was best, or caused a cutoff, when the
+    // position was last searched. The column is that of position, even
+    // though the entry is shared with its mirror image.
+    int column;
+  };
+
+  // Returns the bounds stored for position, if any.
+  //
+  // The table measures Score depths from the position itself, so that
+  // an entry is good wherever the position occurs. The caller passes
+  // level, the depth of the position in its own search, and sees depths
+  // measured from the root of that search.
+  std::optional<Bounds> Lookup(const Board::Position &position,
+                               std::size_t level) const;
+
+  // The same, but with the best move as well.
+  std::optional<Entry> Probe(const Board::Position &position,
+                             std::size_t level) const;
+
+  // Combines bounds with whatever is already known about position. The
+  // column replaces the one stored, unless it is kNoColumn. Returns
+  // whether an entry for another position was thrown out to make room.
+  bool Store(const Board::Position &position, std::size_t level,
+             Bounds bounds, int column = kNoColumn);
+
+  // Marks all the entries as belonging to an earlier search, making them
+  // the first to be replaced. Safe to call while other threads are using
+  // the table, though their entries age too.
+  void NewSearch() { age_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Removes all the entries.
+  void Clear();
+
+  // The number of entries the table can hold.
+  std::size_t capacity() const { return num_buckets_ * kBucketSize; }
+
+ private:
+  static constexpr std::size_t kBucketSize = 8;
+
+  struct alignas(64) Bucket {
+    std::atomic<std::uint64_t> entries[kBucketSize];
+  };
+
+  // Where the entry for position is found. Flipped is set if the entry
+  // is stored for the mirror image of position.
+  struct Slot {
+    std::uint64_t hash;
+    bool flipped;
+  };
+  static Slot Locate(const Board::Position &position);
+
+  // Packs and unpacks an entry. Columns are stored as column + 1, so that
+  // kNoColumn is zero.
+  static std::uint64_t Pack(std::uint64_t hash, const Bounds &bounds,
+                            unsigned int work, std::uint8_t age,
+                            unsigned int column);
+  static Bounds Unpack(std::uint64_t entry);
+
+  const Bucket &BucketFor(std::uint64_t hash) const {
+    return buckets_[hash & (num_buckets_ - 1)];
+  }
+  Bucket &BucketFor(std::uint64_t hash) {
+    return buckets_[hash & (num_buckets_ - 1)];
+  }
+
+  std::size_t num_buckets_;
+  std::unique_ptr<Bucket[]> buckets_;
+  std::atomic<std::uint8_t> age_ = 0;
+};
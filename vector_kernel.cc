@@ -0,0 +1,268 @@
+#include "vector_kernel.h"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define C4_VECTOR_KERNEL 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only allow the AVX2 intrinsics in functions that are
+// marked as using them. MSVC allows them anywhere.
+#if defined(__GNUC__)
+#define C4_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define C4_TARGET_AVX2
+#endif
+
+namespace {
+
+// The four-in-a-rows, padded out to a whole number of vectors by
+// repeating the last one. Looking at a four-in-a-row twice changes none
+// of the answers but the score, which leaves out the padding.
+constexpr std::size_t kLanes = 4;
+constexpr std::size_t kNumVectors =
+    (Board::kNumFours + kLanes - 1) / kLanes;
+
+alignas(32) constexpr auto kMasks = [] {
+  std::array<Board::BoardMask, kNumVectors * kLanes> result{};
+  const Board::MaskArray masks = Board::winning_masks();
+  for (std::size_t i = 0; i < result.size(); ++i) {
+    result[i] = masks[i < masks.size() ? i : masks.size() - 1];
+  }
+  return result;
+}();
+
+// The score of one four-in-a-row.
+int LineScore(Board::BoardMask mask, Board::BoardMask mine,
+              Board::BoardMask theirs) {
+  const int my_count = std::popcount(mine & mask);
+  const int their_count = std::popcount(theirs & mask);
+  return their_count == 0 ? my_count : my_count == 0 ? -their_count : 0;
+}
+
+#ifdef C4_VECTOR_KERNEL
+
+bool CpuHasAvx2() {
+#ifdef _MSC_VER
+  // AVX2 needs the processor to have it, and the operating system to
+  // save the YMM registers.
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+C4_TARGET_AVX2 __m256i LoadMasks(std::size_t i) {
+  return _mm256_load_si256(
+      reinterpret_cast<const __m256i *>(&kMasks[i * kLanes]));
+}
+
+// Ors the four 64-bit lanes of v together.
+C4_TARGET_AVX2 std::uint64_t OrLanes(__m256i v) {
+  const __m128i half = _mm_or_si128(_mm256_castsi256_si128(v),
+                                    _mm256_extracti128_si256(v, 1));
+  return static_cast<std::uint64_t>(_mm_cvtsi128_si64(half)) |
+         static_cast<std::uint64_t>(_mm_extract_epi64(half, 1));
+}
+
+// The number of bits set in each 64-bit lane of v. Looks up the count
+// for each nibble, then adds up the bytes of each lane.
+C4_TARGET_AVX2 __m256i PopCount(__m256i v) {
+  const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3,
+                                         2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+  const __m256i low = _mm256_and_si256(v, low_nibbles);
+  const __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles);
+  const __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, low),
+                                         _mm256_shuffle_epi8(table, high));
+  return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+#else
+
+bool CpuHasAvx2() { return false; }
+
+#endif
+
+}  // namespace
+
+namespace detail {
+
+Board::BoardMask ScalarFindTriples(Board::BoardMask board) {
+  Board::BoardMask result = 0;
+  for (const Board::BoardMask mask : kMasks) {
+    const Board::BoardMask hole = mask & ~board;
+    if (hole != 0 && (hole & (hole - 1)) == 0) {
+      result |= hole;
+    }
+  }
+  return result;
+}
+
+Board::Outcome ScalarFindOutcome(Board::BoardMask red_set,
+                                 Board::BoardMask yellow_set) {
+  bool red_wins = false;
+  bool yellow_wins = false;
+  bool contested = false;
+  for (const Board::BoardMask mask : kMasks) {
+    red_wins |= (red_set & mask) == mask;
+    yellow_wins |= (yellow_set & mask) == mask;
+    contested |= (red_set & mask) == 0 || (yellow_set & mask) == 0;
+  }
+  return red_wins      ? Board::Outcome::kRedWins
+         : yellow_wins ? Board::Outcome::kYellowWins
+         : contested   ? Board::Outcome::kContested
+                       : Board::Outcome::kDraw;
+}
+
+int ScalarScore(Board::BoardMask mine, Board::BoardMask theirs) {
+  int result = 0;
+  for (std::size_t i = 0; i < Board::kNumFours; ++i) {
+    result += LineScore(kMasks[i], mine, theirs);
+  }
+  return result;
+}
+
+#ifdef C4_VECTOR_KERNEL
+
+C4_TARGET_AVX2 Board::BoardMask Avx2FindTriples(Board::BoardMask board) {
+  const __m256i not_board =
+      _mm256_set1_epi64x(static_cast<long long>(~board));
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi64x(1);
+  __m256i result = zero;
+  for (std::size_t i = 0; i < kNumVectors; ++i) {
+    // The empty squares in each four-in-a-row. If there is exactly one,
+    // it is a hole that completes three in a row.
+    const __m256i holes = _mm256_and_si256(LoadMasks(i), not_board);
+    const __m256i others =
+        _mm256_and_si256(holes, _mm256_sub_epi64(holes, one));
+    const __m256i single = _mm256_andnot_si256(
+        _mm256_cmpeq_epi64(holes, zero), _mm256_cmpeq_epi64(others, zero));
+    result = _mm256_or_si256(result, _mm256_and_si256(holes, single));
+  }
+  return OrLanes(result);
+}
+
+C4_TARGET_AVX2 Board::Outcome Avx2FindOutcome(Board::BoardMask red_set,
+                                              Board::BoardMask yellow_set) {
+  const __m256i red = _mm256_set1_epi64x(static_cast<long long>(red_set));
+  const __m256i yellow =
+      _mm256_set1_epi64x(static_cast<long long>(yellow_set));
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i red_wins = zero;
+  __m256i yellow_wins = zero;
+  __m256i contested = zero;
+  for (std::size_t i = 0; i < kNumVectors; ++i) {
+    const __m256i masks = LoadMasks(i);
+    const __m256i red_bits = _mm256_and_si256(masks, red);
+    const __m256i yellow_bits = _mm256_and_si256(masks, yellow);
+    red_wins = _mm256_or_si256(red_wins, _mm256_cmpeq_epi64(red_bits, masks));
+    yellow_wins =
+        _mm256_or_si256(yellow_wins, _mm256_cmpeq_epi64(yellow_bits, masks));
+    contested = _mm256_or_si256(
+        contested, _mm256_or_si256(_mm256_cmpeq_epi64(red_bits, zero),
+                                   _mm256_cmpeq_epi64(yellow_bits, zero)));
+  }
+  return !_mm256_testz_si256(red_wins, red_wins)
+             ? Board::Outcome::kRedWins
+         : !_mm256_testz_si256(yellow_wins, yellow_wins)
+             ? Board::Outcome::kYellowWins
+         : !_mm256_testz_si256(contested, contested)
+             ? Board::Outcome::kContested
+             : Board::Outcome::kDraw;
+}
+
+C4_TARGET_AVX2 int Avx2Score(Board::BoardMask mine, Board::BoardMask theirs) {
+  const __m256i my_pieces = _mm256_set1_epi64x(static_cast<long long>(mine));
+  const __m256i their_pieces =
+      _mm256_set1_epi64x(static_cast<long long>(theirs));
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i total = zero;
+  // The vectors with no padding.
+  constexpr std::size_t kWholeVectors = Board::kNumFours / kLanes;
+  for (std::size_t i = 0; i < kWholeVectors; ++i) {
+    const __m256i masks = LoadMasks(i);
+    const __m256i my_counts = PopCount(_mm256_and_si256(masks, my_pieces));
+    const __m256i their_counts =
+        PopCount(_mm256_and_si256(masks, their_pieces));
+    // Count mine where there are none of theirs, and subtract theirs where
+    // there are none of mine.
+    total = _mm256_add_epi64(
+        total, _mm256_and_si256(my_counts,
+                                _mm256_cmpeq_epi64(their_counts, zero)));
+    total = _mm256_sub_epi64(
+        total, _mm256_and_si256(their_counts,
+                                _mm256_cmpeq_epi64(my_counts, zero)));
+  }
+  const __m128i half = _mm_add_epi64(_mm256_castsi256_si128(total),
+                                     _mm256_extracti128_si256(total, 1));
+  int result =
+      static_cast<int>(_mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1));
+  for (std::size_t i = kWholeVectors * kLanes; i < Board::kNumFours; ++i) {
+    result += LineScore(kMasks[i], mine, theirs);
+  }
+  return result;
+}
+
+#else
+
+// Never called, since HaveAvx2 is false.
+
+Board::BoardMask Avx2FindTriples(Board::BoardMask board) {
+  return ScalarFindTriples(board);
+}
+
+Board::Outcome Avx2FindOutcome(Board::BoardMask red_set,
+                               Board::BoardMask yellow_set) {
+  return ScalarFindOutcome(red_set, yellow_set);
+}
+
+int Avx2Score(Board::BoardMask mine, Board::BoardMask theirs) {
+  return ScalarScore(mine, theirs);
+}
+
+#endif
+
+}  // namespace detail
+
+bool HaveAvx2() {
+  static const bool have_avx2 = CpuHasAvx2();
+  return have_avx2;
+}
+
+Board::BoardMask VectorFindTriples(Board::BoardMask board) {
+  return HaveAvx2() ? detail::Avx2FindTriples(board)
+                    : detail::ScalarFindTriples(board);
+}
+
+Board::Outcome VectorFindOutcome(Board::BoardMask red_set,
+                                 Board::BoardMask yellow_set) {
+  return HaveAvx2() ? detail::Avx2FindOutcome(red_set, yellow_set)
+                    : detail::ScalarFindOutcome(red_set, yellow_set);
+}
+
+int VectorScore(Board::BoardMask mine, Board::BoardMask theirs) {
+  return HaveAvx2() ? detail::Avx2Score(mine, theirs)
+                    : detail::ScalarScore(mine, theirs);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "board.h"
+
+// Versions of FindTriples and FindOutcome, and a from-scratch version of
+// the heuristic score, that test a board against the four-in-a-rows four
+// at a time with AVX2 instructions. The choice of code is made at run
+// time: on a processor without AVX2 (or a compiler without the
+// intrinsics), each falls back to a plain loop over the four-in-a-rows.
+//
+// The shift-based FindTriples and FindOutcome in board.h are what the
+// search uses. These are here to be measured against them (see c4bench),
+// and as independent checks in the tests.
+
+// Whether the AVX2 versions are in use.
+bool HaveAvx2();
+
+// The same as FindTriples.
+Board::BoardMask VectorFindTriples(Board::BoardMask board);
+
+// The same as FindOutcome.
+Board::Outcome VectorFindOutcome(Board::BoardMask red_set,
+                                 Board::BoardMask yellow_set);
+
+// The same as ReferenceScore.
+int VectorScore(Board::BoardMask mine, Board::BoardMask theirs);
+
+// The two versions that the functions above choose between, so the tests
+// can check both on any processor. The AVX2 versions may only be called
+// if HaveAvx2().
+namespace detail {
+
+Board::BoardMask ScalarFindTriples(Board::BoardMask board);
+Board::Outcome ScalarFindOutcome(Board::BoardMask red_set,
+                                 Board::BoardMask yellow_set);
+int ScalarScore(Board::BoardMask mine, Board::BoardMask theirs);
+
+Board::BoardMask Avx2FindTriples(Board::BoardMask board);
+Board::Outcome Avx2FindOutcome(Board::BoardMask red_set,
+                               Board::BoardMask yellow_set);
+int Avx2Score(Board::BoardMask mine, Board::BoardMask theirs);
+
+}  // namespace detail